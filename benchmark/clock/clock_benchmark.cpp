@@ -0,0 +1,61 @@
+#include <fastws/clock.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static constexpr int iters = 10000000;
+
+// average ns per call of f
+template <class F> static double cost(F f) {
+    std::uint64_t sink = 0;
+    const std::uint64_t start = fastws::clock::raw_ns();
+    for (int i = 0; i < iters; i++) {
+        sink += f();
+    }
+    const std::uint64_t end = fastws::clock::raw_ns();
+    if (sink == 42)
+        std::cout << std::endl;
+    return ((double)(end - start)) / iters;
+}
+
+static void report(const std::string& name, double ns) {
+    std::cout << name << ": " << ns << " ns" << std::endl;
+}
+
+int main() {
+    std::cout << "invariant tsc: " << fastws::clock::invariant_tsc()
+              << ", using tsc: " << fastws::clock::uses_tsc() << std::endl;
+
+    report("fastws::clock::ticks", cost([] { return fastws::clock::ticks(); }));
+    report("fastws::clock::ticks_end",
+           cost([] { return fastws::clock::ticks_end(); }));
+    report("fastws::clock::now_ns",
+           cost([] { return fastws::clock::now_ns(); }));
+    report("clock_gettime(CLOCK_MONOTONIC_RAW)",
+           cost([] { return fastws::clock::raw_ns(); }));
+    report("std::chrono::steady_clock", cost([] {
+               return (std::uint64_t)std::chrono::steady_clock::now()
+                   .time_since_epoch()
+                   .count();
+           }));
+    report("std::chrono::high_resolution_clock", cost([] {
+               return (std::uint64_t)std::chrono::high_resolution_clock::now()
+                   .time_since_epoch()
+                   .count();
+           }));
+
+    // how far the calibrated clock wanders from CLOCK_MONOTONIC_RAW
+    const std::int64_t offset =
+        fastws::clock::now_ns() - fastws::clock::raw_ns();
+    for (int i = 0; i < 5; i++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        const std::int64_t drift =
+            (fastws::clock::now_ns() - fastws::clock::raw_ns()) - offset;
+        std::cout << "drift after " << i + 1 << "s: " << drift << " ns"
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <fastws/clock.hpp>
+#include <fastws/resolver.hpp>
+#include <fastws/socket_wrapper.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr int iters = 2000;
+
+// listens on an ephemeral port of localhost, connections are accepted and
+// closed after each iteration
+struct Listener {
+    int fd = -1;
+    long port = 0;
+
+    Listener() {
+        auto addr = fastws::ResolvedAddress::from_numeric("127.0.0.1", 0);
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if ((::bind(fd, addr.get(), addr.len) != 0) ||
+            (::listen(fd, 128) != 0))
+            throw std::runtime_error("Failed to listen");
+        socklen_t len = addr.len;
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr.addr), &len);
+        port = ntohs(reinterpret_cast<sockaddr_in*>(&addr.addr)->sin_port);
+    }
+
+    void drain() {
+        int conn = ::accept(fd, nullptr, nullptr);
+        if (conn >= 0)
+            ::close(conn);
+    }
+
+    ~Listener() { ::close(fd); }
+};
+
+template <class F>
+static void run(const std::string& name, Listener& listener, F connect) {
+    std::vector<double> times;
+    for (int i = 0; i < iters; i++) {
+        const std::uint64_t start = fastws::clock::ticks();
+        connect(listener.port);
+        const std::uint64_t end = fastws::clock::ticks_end();
+        times.push_back(fastws::clock::to_ns(end - start) * 0.001);
+        listener.drain();
+    }
+    std::sort(times.begin(), times.end());
+    std::cout << name << ": median " << times[times.size() / 2]
+              << " us, p99 " << times[(times.size() * 99) / 100] << " us"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // a name that goes through the system resolver (e.g. /etc/hosts)
+    const std::string host = argc > 1 ? argv[1] : "localhost";
+    Listener listener;
+
+    run("getaddrinfo every connect", listener, [&](long port) {
+        fastws::SocketWrapper<> socket(host, port,
+                                       fastws::getaddrinfo_lookup(host, port));
+    });
+
+    fastws::Resolver resolver;
+    run("warm resolver cache", listener, [&](long port) {
+        fastws::SocketWrapper<> socket(host, port, resolver);
+    });
+
+    auto addrs = resolver.resolve(host, listener.port);
+    run("cached sockaddr", listener, [&](long port) {
+        fastws::SocketWrapper<> socket(host, port, *addrs);
+    });
+    return 0;
+}
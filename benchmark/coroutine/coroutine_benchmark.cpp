@@ -0,0 +1,286 @@
+#include <fastws/coro.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Per-message cost of the callback APIs against the coroutine one. A local
+// server answers "n" with a burst of n small binary frames, and each round
+// times the burst from the request to the last message handled. Allocations
+// are counted on the client's thread, to check that awaiting (and starting
+// a task per message) doesn't allocate once things are warmed up.
+
+static constexpr int message_size = 32;
+static constexpr int burst = 100000;
+static constexpr int rounds = 20;
+
+static thread_local std::uint64_t allocations = 0;
+
+void* operator new(std::size_t size) {
+    allocations++;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+// out of line, or gcc pairs free() up with the operator new it inlined
+// and warns about a mismatch
+__attribute__((noinline)) static void release(void* ptr) { std::free(ptr); }
+
+void operator delete(void* ptr) noexcept { release(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { release(ptr); }
+
+static std::string upgrade_response(const std::string& request) {
+    static const std::string guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    const auto start = request.find("Sec-WebSocket-Key: ") + 19;
+    const auto key =
+        request.substr(start, request.find("\r\n", start) - start);
+    unsigned char sha[SHA_DIGEST_LENGTH];
+    const auto input = key + guid;
+    SHA1((const unsigned char*)input.data(), input.size(), sha);
+    unsigned char accept[64];
+    EVP_EncodeBlock(accept, sha, SHA_DIGEST_LENGTH);
+    return "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+           "Connection: Upgrade\r\nSec-WebSocket-Accept: " +
+           std::string((char*)accept) + "\r\n\r\n";
+}
+
+// one connection at a time, text frames are burst requests
+struct Server {
+    long port = 0;
+    int fd = -1;
+    std::thread thread;
+
+    Server() {
+        auto addr = fastws::ResolvedAddress::from_numeric("127.0.0.1", 0);
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if ((::bind(fd, addr.get(), addr.len) != 0) ||
+            (::listen(fd, 4) != 0))
+            throw std::runtime_error("Failed to listen");
+        socklen_t len = addr.len;
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr.addr), &len);
+        port = ntohs(reinterpret_cast<sockaddr_in*>(&addr.addr)->sin_port);
+        thread = std::thread([this] { run(); });
+    }
+
+    static void send_all(int conn, const std::string& data) {
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            const ssize_t n = ::send(conn, data.data() + sent,
+                                     data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return;
+            sent += n;
+        }
+    }
+
+    void serve(int conn) {
+        std::string in;
+        char buf[4096];
+        bool upgraded = false;
+        std::string frame = "\x82";
+        frame += char(message_size);
+        frame += std::string(message_size, 'x');
+        for (;;) {
+            const ssize_t n = ::recv(conn, buf, sizeof(buf), 0);
+            if (n <= 0)
+                break;
+            in.append(buf, n);
+            if (!upgraded) {
+                const auto end = in.find("\r\n\r\n");
+                if (end == std::string::npos)
+                    continue;
+                send_all(conn, upgrade_response(in.substr(0, end)));
+                in.erase(0, end + 4);
+                upgraded = true;
+            }
+            while ((in.size() >= 6) &&
+                   (in.size() >= 6 + (std::size_t)(in[1] & 0x7F))) {
+                const std::size_t len = in[1] & 0x7F;
+                std::string payload = in.substr(6, len);
+                for (std::size_t i = 0; i < len; i++) {
+                    payload[i] ^= in[2 + i % 4];
+                }
+                const unsigned char opcode = in[0] & 0x0F;
+                in.erase(0, 6 + len);
+                if (opcode == 0x8) {
+                    ::close(conn);
+                    return;
+                }
+                if (opcode == 0x1) {
+                    std::string out;
+                    const int count = std::stoi(payload);
+                    out.reserve(frame.size() * count);
+                    for (int i = 0; i < count; i++) {
+                        out += frame;
+                    }
+                    send_all(conn, out);
+                }
+            }
+        }
+        ::close(conn);
+    }
+
+    void run() {
+        int conn;
+        while ((conn = ::accept(fd, nullptr, nullptr)) >= 0) {
+            serve(conn);
+        }
+    }
+
+    ~Server() {
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+        thread.join();
+    }
+};
+
+struct Result {
+    std::vector<double> ns_per_message;
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+};
+
+static void report(const std::string& name, Result& result) {
+    auto& times = result.ns_per_message;
+    std::sort(times.begin(), times.end());
+    std::cout << name << ": median " << times[times.size() / 2]
+              << " ns/msg, min " << times.front() << " ns/msg, "
+              << (double)result.allocations / (double)(burst * rounds)
+              << " allocations/msg" << std::endl;
+}
+
+template <class Features = fastws::DefaultFeatures> struct FrameHandler {
+    using Client = fastws::NoTLSClient<FrameHandler, Features>;
+    int count = 0;
+    std::uint64_t bytes = 0;
+    void on_open(Client& client) {}
+    void on_close(Client& client, bool success) {}
+    void on_text(Client& client, wsframe::Frame frame) {}
+    void on_binary(Client& client, wsframe::Frame frame) {
+        count++;
+        bytes += frame.payload.size();
+    }
+    void on_continuation(Client& client, wsframe::Frame frame) {}
+};
+
+struct BatchHandler {
+    using Client = fastws::NoTLSClient<BatchHandler>;
+    int count = 0;
+    std::uint64_t bytes = 0;
+    void on_open(Client& client) {}
+    void on_close(Client& client, bool success) {}
+    void on_text(Client& client, wsframe::Frame frame) {}
+    void on_binary(Client& client, wsframe::Frame frame) {}
+    void on_continuation(Client& client, wsframe::Frame frame) {}
+    void on_batch(Client& client, fastws::FrameBatch frames) {
+        count += frames.size();
+        for (const auto& frame : frames) {
+            bytes += frame.payload.size();
+        }
+    }
+};
+
+// to see what the RTT stats and connection counters cost
+struct NoStats : fastws::DefaultFeatures {
+    static constexpr bool instrumentation = false;
+};
+
+template <class Handler> static Result run_callbacks(long port) {
+    Result result;
+    result.ns_per_message.reserve(rounds);
+    Handler handler;
+    typename Handler::Client client(handler, "127.0.0.1", "/", port);
+    const std::string request = std::to_string(burst);
+    for (int round = -1; round < rounds; round++) {
+        const std::uint64_t start = fastws::clock::now_ns();
+        const std::uint64_t allocations_before = allocations;
+        handler.count = 0;
+        client.send_text(request);
+        while ((handler.count < burst) &&
+               (client.drain() == fastws::ConnectionStatus::HEALTHY)) {
+        }
+        // the first round warms up the buffers
+        if (round < 0)
+            continue;
+        result.allocations += allocations - allocations_before;
+        result.ns_per_message.push_back(
+            (double)(fastws::clock::now_ns() - start) / burst);
+    }
+    result.bytes = handler.bytes;
+    return result;
+}
+
+static fastws::Task<> handle(fastws::Message message, Result& result) {
+    result.bytes += message.payload.size();
+    co_return;
+}
+
+static fastws::Task<> consume(fastws::NoTLSCoClient& client, Result& result,
+                              bool task_per_message) {
+    co_await client.connect();
+    const std::string request = std::to_string(burst);
+    for (int round = -1; round < rounds; round++) {
+        const std::uint64_t start = fastws::clock::now_ns();
+        const std::uint64_t allocations_before = allocations;
+        co_await client.send_text(request);
+        for (int i = 0; i < burst; i++) {
+            auto message = co_await client.receive();
+            if (message.closed())
+                co_return;
+            if (task_per_message) {
+                co_await handle(message, result);
+            } else {
+                result.bytes += message.payload.size();
+            }
+        }
+        if (round < 0)
+            continue;
+        result.allocations += allocations - allocations_before;
+        result.ns_per_message.push_back(
+            (double)(fastws::clock::now_ns() - start) / burst);
+    }
+}
+
+static Result run_coroutine(long port, bool task_per_message) {
+    Result result;
+    result.ns_per_message.reserve(rounds);
+    fastws::NoTLSCoClient client("127.0.0.1", "/", port);
+    auto task = consume(client, result, task_per_message);
+    task.start();
+    while (!task.done()) {
+        if (client.drain() != fastws::ConnectionStatus::HEALTHY)
+            break;
+    }
+    task.result();
+    return result;
+}
+
+int main() {
+    Server server;
+    std::cout << rounds << " bursts of " << burst << " " << message_size
+              << " byte messages" << std::endl;
+    auto callbacks = run_callbacks<FrameHandler<>>(server.port);
+    report("callbacks", callbacks);
+    auto uncounted = run_callbacks<FrameHandler<NoStats>>(server.port);
+    report("callbacks without instrumentation", uncounted);
+    auto batches = run_callbacks<BatchHandler>(server.port);
+    report("on_batch", batches);
+    auto coroutine = run_coroutine(server.port, false);
+    report("co_await receive()", coroutine);
+    auto tasks = run_coroutine(server.port, true);
+    report("co_await receive() + task per message", tasks);
+    return 0;
+}
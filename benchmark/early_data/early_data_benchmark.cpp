@@ -0,0 +1,341 @@
+#include <fastws/fastws.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Time from starting to connect to the first data arriving for a
+// subscription, for a new TLS session, a resumed one, and a resumed one that
+// sends the upgrade request as 0-RTT early data, subscribing either from
+// on_open or pipelined behind the upgrade request. The server is OpenSSL on
+// localhost behind a proxy that delays everything by rtt/2 each way.
+
+static constexpr int iters = 20;
+
+static int listen_on(long& port) {
+    auto addr = fastws::ResolvedAddress::from_numeric("127.0.0.1", 0);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if ((::bind(fd, addr.get(), addr.len) != 0) || (::listen(fd, 16) != 0))
+        throw std::runtime_error("Failed to listen");
+    socklen_t len = addr.len;
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr.addr), &len);
+    port = ntohs(reinterpret_cast<sockaddr_in*>(&addr.addr)->sin_port);
+    return fd;
+}
+
+static SSL_CTX* make_server_ctx() {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               (const unsigned char*)"localhost", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate(ctx, cert);
+    SSL_CTX_use_PrivateKey(ctx, key);
+    SSL_CTX_set_max_early_data(ctx, 16384);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ctx;
+}
+
+static std::string upgrade_response(const std::string& request) {
+    static const std::string guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    const auto start = request.find("Sec-WebSocket-Key: ") + 19;
+    const auto key =
+        request.substr(start, request.find("\r\n", start) - start);
+    unsigned char sha[SHA_DIGEST_LENGTH];
+    const auto input = key + guid;
+    SHA1((const unsigned char*)input.data(), input.size(), sha);
+    unsigned char accept[64];
+    EVP_EncodeBlock(accept, sha, SHA_DIGEST_LENGTH);
+    return "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+           "Connection: Upgrade\r\nSec-WebSocket-Accept: " +
+           std::string((char*)accept) + "\r\n\r\n";
+}
+
+// WebSocket server that handles whatever it has as soon as it has it,
+// including a request (and messages behind it) sent as early data. Text
+// messages are subscriptions, answered with a "data" message.
+struct Server {
+    SSL_CTX* ctx = make_server_ctx();
+    long port = 0;
+    int fd = listen_on(port);
+    std::atomic<int> early_accepted{0};
+    std::thread thread{[this] { run(); }};
+
+    struct Connection {
+        std::string in;
+        std::string out;
+        bool upgraded = false;
+        bool closed = false;
+
+        void handle() {
+            if (!upgraded) {
+                const auto end = in.find("\r\n\r\n");
+                if (end == std::string::npos)
+                    return;
+                out += upgrade_response(in.substr(0, end));
+                in.erase(0, end + 4);
+                upgraded = true;
+            }
+            while (in.size() >= 2) {
+                const unsigned char opcode = in[0] & 0x0F;
+                std::size_t len = in[1] & 0x7F;
+                std::size_t header = 6;
+                if (len == 126) {
+                    if (in.size() < 4)
+                        return;
+                    len = ((unsigned char)in[2] << 8) | (unsigned char)in[3];
+                    header = 8;
+                }
+                if (in.size() < header + len)
+                    return;
+                std::string payload = in.substr(header, len);
+                for (std::size_t i = 0; i < len; i++) {
+                    payload[i] ^= in[header - 4 + i % 4];
+                }
+                in.erase(0, header + len);
+                if (opcode == 0x1) {
+                    out += "\x81\x04"
+                           "data";
+                } else if (opcode == 0x9) {
+                    out += std::string("\x8a") + char(len) + payload;
+                } else if (opcode == 0x8) {
+                    out += std::string("\x88\x00", 2);
+                    closed = true;
+                    return;
+                }
+            }
+        }
+    };
+
+    void serve(int conn) {
+        int one = 1;
+        ::setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        SSL* ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, conn);
+        Connection c;
+        char buf[4096];
+        for (;;) {
+            std::size_t n = 0;
+            const int ret = SSL_read_early_data(ssl, buf, sizeof(buf), &n);
+            if (ret == SSL_READ_EARLY_DATA_ERROR)
+                break;
+            c.in.append(buf, n);
+            c.handle();
+            if (!c.out.empty()) {
+                // answered before the handshake is even done
+                std::size_t written = 0;
+                SSL_write_early_data(ssl, c.out.data(), c.out.size(),
+                                     &written);
+                c.out.clear();
+            }
+            if (ret == SSL_READ_EARLY_DATA_FINISH)
+                break;
+        }
+        if (c.upgraded)
+            early_accepted++;
+        if (SSL_do_handshake(ssl) == 1) {
+            while (!c.closed) {
+                std::size_t n = 0;
+                if (SSL_read_ex(ssl, buf, sizeof(buf), &n) <= 0)
+                    break;
+                c.in.append(buf, n);
+                c.handle();
+                if (!c.out.empty())
+                    SSL_write(ssl, c.out.data(), c.out.size());
+                c.out.clear();
+            }
+        }
+        // a session that isn't shut down cleanly can't be resumed
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        ::close(conn);
+    }
+
+    void run() {
+        int conn;
+        while ((conn = ::accept(fd, nullptr, nullptr)) >= 0) {
+            std::thread([this, conn] { serve(conn); }).detach();
+        }
+    }
+
+    ~Server() {
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+        thread.join();
+        SSL_CTX_free(ctx);
+    }
+};
+
+// forwards connections to the server, holding everything back by delay
+struct DelayProxy {
+    long upstream;
+    std::uint64_t delay_ns;
+    long port = 0;
+    int fd = listen_on(port);
+    std::thread thread{[this] { run(); }};
+
+    struct Chunk {
+        std::uint64_t at;
+        std::string data;
+    };
+
+    void pipe(int client) {
+        std::size_t winner;
+        std::uint64_t connect_ns;
+        fastws::AddressList addrs = {
+            fastws::ResolvedAddress::from_numeric("127.0.0.1", upstream)};
+        int server = fastws::detail::race_connect<false>(addrs, {}, winner,
+                                                         connect_ns);
+        int fds[2] = {client, server};
+        std::deque<Chunk> queues[2];
+        char buf[1 << 16];
+        for (;;) {
+            const std::uint64_t now = fastws::clock::now_ns();
+            int timeout = -1;
+            for (auto& q : queues) {
+                if (q.empty())
+                    continue;
+                const int wait =
+                    q.front().at > now
+                        ? (int)((q.front().at - now + 999999) / 1000000)
+                        : 0;
+                timeout = timeout < 0 ? wait : std::min(timeout, wait);
+            }
+            pollfd pfds[2] = {{fds[0], POLLIN, 0}, {fds[1], POLLIN, 0}};
+            ::poll(pfds, 2, timeout);
+            for (int i = 0; i < 2; i++) {
+                if ((fds[i] < 0) ||
+                    !(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                    continue;
+                const ssize_t n = ::recv(fds[i], buf, sizeof(buf), 0);
+                // an empty chunk passes the close on, in order
+                queues[i].push_back({fastws::clock::now_ns() + delay_ns,
+                                     std::string(buf, n > 0 ? n : 0)});
+                if (n <= 0)
+                    fds[i] = -1;
+            }
+            for (int i = 0; i < 2; i++) {
+                while ((!queues[i].empty()) &&
+                       (queues[i].front().at <= fastws::clock::now_ns())) {
+                    const auto& data = queues[i].front().data;
+                    if (data.empty()) {
+                        ::close(client);
+                        ::close(server);
+                        return;
+                    }
+                    (void)!::send(i == 0 ? server : client, data.data(),
+                                  data.size(), MSG_NOSIGNAL);
+                    queues[i].pop_front();
+                }
+            }
+        }
+    }
+
+    void run() {
+        int conn;
+        while ((conn = ::accept(fd, nullptr, nullptr)) >= 0) {
+            int one = 1;
+            ::setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::thread([this, conn] { pipe(conn); }).detach();
+        }
+    }
+
+    ~DelayProxy() {
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+        thread.join();
+    }
+};
+
+// subscribes from on_open (once the upgrade is done), or from on_handshake
+// to have the subscription go out right behind the upgrade request
+struct FrameHandler {
+    using Client = fastws::TLSClient<FrameHandler>;
+    bool pipeline = false;
+    bool got_data = false;
+    void on_handshake(Client& client) {
+        if (pipeline)
+            client.send_text("subscribe");
+    }
+    void on_open(Client& client) {
+        if (!pipeline)
+            client.send_text("subscribe");
+    }
+    void on_close(Client& client, bool success) {}
+    void on_text(Client& client, wsframe::Frame frame) { got_data = true; }
+    void on_binary(Client& client, wsframe::Frame frame) {}
+    void on_continuation(Client& client, wsframe::Frame frame) {}
+};
+
+static double time_to_first_data(long port, bool pipeline) {
+    FrameHandler handler;
+    handler.pipeline = pipeline;
+    const std::uint64_t start = fastws::clock::now_ns();
+    FrameHandler::Client client(handler, "127.0.0.1", "/", port);
+    while ((!handler.got_data) &&
+           (client.drain() == fastws::ConnectionStatus::HEALTHY)) {
+    }
+    return (fastws::clock::now_ns() - start) * 1e-6;
+}
+
+static void run(const std::string& name, long port, bool pipeline) {
+    // the first connection of each mode gets a ticket for the next one
+    time_to_first_data(port, pipeline);
+    std::vector<double> times;
+    for (int i = 0; i < iters; i++) {
+        times.push_back(time_to_first_data(port, pipeline));
+    }
+    std::sort(times.begin(), times.end());
+    std::cout << name << (pipeline ? ", pipelined" : ", on_open")
+              << ": median " << times[times.size() / 2] << " ms, max "
+              << times.back() << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    const double rtt_ms = argc > 1 ? std::stod(argv[1]) : 10;
+    Server server;
+    DelayProxy proxy{server.port, (std::uint64_t)(rtt_ms * 0.5e6)};
+    auto& sessions = fastws::TLSSessionCache::global();
+    std::cout << "rtt " << rtt_ms << " ms, time to first data" << std::endl;
+
+    for (bool pipeline : {false, true}) {
+        sessions.set_enabled(false);
+        run("new session", proxy.port, pipeline);
+
+        sessions.set_enabled(true);
+        sessions.set_early_data(false);
+        run("resumed", proxy.port, pipeline);
+
+        sessions.set_early_data(true);
+        const int before = server.early_accepted;
+        run("resumed + 0-RTT", proxy.port, pipeline);
+        std::cout << "early data accepted " << server.early_accepted - before
+                  << "/" << iters + 1 << std::endl;
+    }
+    return 0;
+}
@@ -2,7 +2,7 @@
 
 #include "benchmark.hpp"
 
-#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <string_view>
@@ -11,11 +11,11 @@ struct FrameHandler {
     using Client = fastws::NoTLSClient<FrameHandler>;
     int count = 0;
     int max_count = NSENDS;
-    std::chrono::high_resolution_clock::time_point start;
-    std::chrono::high_resolution_clock::time_point end;
+    std::uint64_t start; // ns
+    std::uint64_t end;
 
     void on_open(Client& client) {
-        start = std::chrono::high_resolution_clock::now();
+        start = fastws::clock::now_ns();
         client.send_text(MESSAGE);
     }
 
@@ -23,11 +23,8 @@ struct FrameHandler {
         if (frame.payload == MESSAGE) {
             count++;
             if (count >= max_count) {
-                end = std::chrono::high_resolution_clock::now();
-                double total_time =
-                    std::chrono::duration_cast<std::chrono::nanoseconds>(end -
-                                                                         start)
-                        .count();
+                end = fastws::clock::now_ns();
+                double total_time = end - start;
                 std::cout << "total time (us): " << total_time * 0.001
                           << std::endl;
                 std::cout << "average_rtt (us): "
@@ -47,7 +44,7 @@ struct FrameHandler {
 
 int main() {
     set_max_priority();
-    auto start = std::chrono::high_resolution_clock::now();
+    auto start = fastws::clock::now_ns();
     while (true) {
         std::string command;
         std::cin >> command;
@@ -56,13 +53,10 @@ int main() {
     }
     FrameHandler handler;
     FrameHandler::Client client(handler, "127.0.0.1", "/", 9001);
-    while (true)
-        if (client.poll() != fastws::ConnectionStatus::HEALTHY)
-            break;
-    auto end = std::chrono::high_resolution_clock::now();
-    double total_time =
-        std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
-            .count();
+    while (!client.closed())
+        client.poll();
+    auto end = fastws::clock::now_ns();
+    double total_time = (end - start) / 1000000;
     std::cout << "TOTAL_TIME=" << total_time << "ms" << std::endl;
     return 0;
 }
\ No newline at end of file
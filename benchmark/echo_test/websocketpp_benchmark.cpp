@@ -30,7 +30,7 @@
 
 #include "benchmark.hpp"
 
-#include <chrono>
+#include <cstdint>
 #include <iostream>
 
 typedef websocketpp::client<websocketpp::config::asio_client> client;
@@ -45,20 +45,17 @@ typedef websocketpp::config::asio_client::message_type::ptr message_ptr;
 struct Handler {
     int count = 0;
     int max_count = NSENDS;
-    std::chrono::high_resolution_clock::time_point start;
-    std::chrono::high_resolution_clock::time_point end;
+    std::uint64_t start; // ns
+    std::uint64_t end;
 
     void on_message(client* c, websocketpp::connection_hdl hdl,
                     message_ptr msg) {
         if (msg->get_payload() == MESSAGE) {
             count++;
             if (count >= max_count) {
-                end = std::chrono::high_resolution_clock::now();
+                end = fastws::clock::now_ns();
 
-                double total_time =
-                    std::chrono::duration_cast<std::chrono::nanoseconds>(end -
-                                                                         start)
-                        .count();
+                double total_time = end - start;
                 std::cout << "total time (us): " << total_time * 0.001
                           << std::endl;
                 std::cout << "average_rtt (us): "
@@ -76,14 +73,14 @@ struct Handler {
 
     void on_open(websocketpp::connection_hdl hdl, client* c) {
         websocketpp::lib::error_code ec;
-        start = std::chrono::high_resolution_clock::now();
+        start = fastws::clock::now_ns();
         c->send(hdl, MESSAGE, websocketpp::frame::opcode::text, ec);
     }
 };
 
 int main(int argc, char* argv[]) {
     set_max_priority();
-    auto start = std::chrono::high_resolution_clock::now();
+    auto start = fastws::clock::now_ns();
     while (true) {
         std::string command;
         std::cin >> command;
@@ -126,10 +123,8 @@ int main(int argc, char* argv[]) {
         std::cout << e.what() << std::endl;
     }
 
-    auto end = std::chrono::high_resolution_clock::now();
-    double total_time =
-        std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
-            .count();
+    auto end = fastws::clock::now_ns();
+    double total_time = (end - start) / 1000000;
     std::cout << "TOTAL_TIME=" << total_time << "ms" << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -1,21 +1,8 @@
 #ifndef _BENCHMARK_BENCHMARK_HPP_
 #define _BENCHMARK_BENCHMARK_HPP_
 
-#include <pthread.h>
-#include <stdexcept>
+#include <fastws/low_latency.hpp>
 
-static inline void set_max_priority() {
-    pthread_t thread = pthread_self();
-    int policy;
-    sched_param param = {};
-    pthread_getschedparam(thread, &policy, &param);
-    int max_priority = sched_get_priority_max(policy);
-    if (param.sched_priority != max_priority) {
-        param.sched_priority = max_priority;
-        if (pthread_setschedparam(thread, policy, &param) != 0) {
-            throw std::runtime_error("Failed to set thread policy");
-        }
-    }
-}
+using fastws::set_max_priority;
 
 #endif // _BENCHMARK_BENCHMARK_HPP_
\ No newline at end of file
@@ -9,8 +9,9 @@
 
 struct FrameHandler {
     using Client = fastws::NoTLSClient<FrameHandler>;
+    std::string name = "fastws";
     void on_open(Client& client) {
-        client.send_text("fastws");
+        client.send_text(name);
     }
     void on_text(Client& client, wsframe::Frame frame) {
         client.send_text(frame.payload);
@@ -20,10 +21,27 @@ struct FrameHandler {
     void on_continuation(Client& client, wsframe::Frame frame) {}
 };
 
-int main() {
+// run with "tuned" to compare against the default socket options, results
+// are written to fastws_tuned_simple_latency.csv
+int main(int argc, char* argv[]) {
     set_max_priority();
+    fastws::LowLatencyProfile profile;
+    fastws::HugePageArena arena(profile.arena_size);
+    fastws::BufferPool pool(profile.arena_size, &arena);
     FrameHandler handler;
-    FrameHandler::Client client(handler, "127.0.0.1", "/", 8765);
+    fastws::SocketOptions options;
+    if ((argc > 1) && (std::string(argv[1]) == "tuned")) {
+        handler.name = "fastws_tuned";
+        options.quickack = true;
+        options.busy_poll = 50;
+        options.receive_buffer = 1 << 20;
+        options.send_buffer = 1 << 20;
+    }
+    FrameHandler::Client client(handler, "127.0.0.1", "/", 8765, "", 10, 60,
+                                10, options);
+    client.use_buffer_pool(pool);
+    client.reserve_buffers(profile.receive_buffer, profile.send_buffer);
+    fastws::apply_to_thread(profile);
     while (true)
         if (client.poll() != fastws::ConnectionStatus::HEALTHY)
             break;
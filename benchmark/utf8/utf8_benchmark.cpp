@@ -0,0 +1,91 @@
+#include <fastws/clock.hpp>
+#include <fastws/utf8.hpp>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// something that looks like a ticker/book update from an exchange feed
+static std::string make_payload(std::size_t target_size, bool non_ascii) {
+    std::string out = "{\"type\":\"l2update\",\"product_id\":\"BTC-USD\","
+                      "\"changes\":[";
+    int i = 0;
+    while (out.size() < target_size) {
+        if (i > 0)
+            out += ",";
+        out += "[\"buy\",\"" + std::to_string(64000 + (i * 37) % 1000) +
+               ".12\",\"0." + std::to_string(100000 + i * 7919 % 900000) +
+               "\"]";
+        if (non_ascii && (i % 8 == 0))
+            out += ",\"note\":\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x9a\x80\"";
+        i++;
+    }
+    out += "],\"time\":\"2024-01-01T00:00:00.000000Z\"}";
+    return out;
+}
+
+template <class F>
+static double run(const std::vector<std::string>& payloads, int iters, F f) {
+    std::size_t bytes = 0;
+    std::size_t valid = 0;
+    const std::uint64_t start = fastws::clock::ticks();
+    for (int it = 0; it < iters; it++) {
+        for (const auto& payload : payloads) {
+            valid += f(payload);
+            bytes += payload.size();
+        }
+    }
+    const std::uint64_t end = fastws::clock::ticks_end();
+    double ns = fastws::clock::to_ns(end - start);
+    if (valid != payloads.size() * iters)
+        std::cout << "validation failed!" << std::endl;
+    return ((double)bytes) / ns; // GB/s
+}
+
+int main() {
+    using fastws::utf8::Implementation;
+    std::cout << "detected: "
+              << fastws::utf8::implementation_to_string(
+                     fastws::utf8::detect_implementation())
+              << std::endl;
+
+    for (bool non_ascii : {false, true}) {
+        for (std::size_t size : {128, 1024, 16384, 1 << 20}) {
+            std::vector<std::string> payloads;
+            std::size_t total = 0;
+            while (total < (64 << 20)) {
+                payloads.push_back(make_payload(size, non_ascii));
+                total += payloads.back().size();
+                if (payloads.size() >= 1024)
+                    break;
+            }
+            int iters = std::max<std::size_t>(1, (256 << 20) / total);
+            std::cout << (non_ascii ? "mixed" : "ascii") << " json, "
+                      << payloads[0].size() << " bytes:";
+            for (auto impl : {Implementation::SCALAR, Implementation::SSE4,
+                              Implementation::AVX2}) {
+                if (impl > fastws::utf8::detect_implementation())
+                    continue;
+                double gbs = run(payloads, iters, [&](const std::string& p) {
+                    return fastws::utf8::is_valid(p, impl);
+                });
+                std::cout << " " << fastws::utf8::implementation_to_string(impl)
+                          << "=" << gbs << "GB/s";
+            }
+            // same thing fed in 1500 byte fragments
+            fastws::Utf8Validator validator;
+            double gbs = run(payloads, iters, [&](const std::string& p) {
+                std::string_view view(p);
+                while (view.size() > 1500) {
+                    validator.update(view.substr(0, 1500));
+                    view.remove_prefix(1500);
+                }
+                return validator.finish(view);
+            });
+            std::cout << " fragmented=" << gbs << "GB/s" << std::endl;
+        }
+    }
+    return 0;
+}
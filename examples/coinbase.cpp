@@ -36,8 +36,22 @@ int main() {
     FrameHandler handler;
     FrameHandler::Client client(handler, "ws-feed.exchange.coinbase.com", "/",
                                 443);
-    while (should_run)
+
+    // spin while the feed is busy, give the core back when it goes quiet
+    fastws::AdaptiveIdleStrategy idle;
+    idle.add(client.fd());
+    while (should_run) {
         if (client.poll() != fastws::ConnectionStatus::HEALTHY)
             break;
+        idle.idle(client.last_poll_frames() + client.has_buffered_data());
+    }
+
+    const auto& counters = idle.counters();
+    for (auto phase : {fastws::IdlePhase::WORK, fastws::IdlePhase::SPIN,
+                       fastws::IdlePhase::PAUSE, fastws::IdlePhase::YIELD,
+                       fastws::IdlePhase::BLOCK}) {
+        std::cout << fastws::idle_phase_to_string(phase) << ": "
+                  << counters.ns_in(phase) * 1e-6 << " ms" << std::endl;
+    }
     return 0;
 }
\ No newline at end of file
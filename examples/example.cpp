@@ -31,8 +31,7 @@ struct FrameHandler {
 int main() {
     FrameHandler handler;
     FrameHandler::Client client(handler, "echo.websocket.org", "/", 443);
-    while (true)
-        if (client.poll() != fastws::ConnectionStatus::HEALTHY)
-            break;
+    while (!client.closed())
+        client.poll();
     return 0;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
 #!/usr/bin/env bash
 
-quom include/fastws/fastws.hpp single_header/fastws.hpp -g _.+_HPP_ -Iinclude/fastws -Iext/plf_nanotimer -Iext/websocket-frame-utility/include
\ No newline at end of file
+mkdir -p single_header
+quom include/fastws/fastws.hpp single_header/fastws.hpp -g _.+_HPP_ -Iinclude/fastws -Iext/websocket-frame-utility/include
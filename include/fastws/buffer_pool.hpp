@@ -0,0 +1,419 @@
+#ifndef _FASTWS_BUFFER_POOL_HPP_
+#define _FASTWS_BUFFER_POOL_HPP_
+
+#include "low_latency.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace fastws {
+
+// Pool of power of two sized slabs shared between the connections polled
+// from one thread (it is not thread safe). Connections borrow slabs for
+// their receive/send buffers while data is in flight and hand them back when
+// they go idle, so a thousand idle connections hold no buffer memory. Slabs
+// that are handed back are cached for reuse up to max_cached_bytes, anything
+// over that is freed. All slabs must be returned before the pool is
+// destroyed. If the pool has an arena, new slabs are carved out of it until
+// it runs out; those are always kept in the pool rather than freed.
+class BufferPool {
+  private:
+    static constexpr std::size_t min_slab_shift = 12; // 4 KB
+
+    std::vector<std::vector<std::uint8_t*>> m_free;
+    std::size_t m_max_cached_bytes;
+    std::size_t m_bytes_cached = 0;
+    std::size_t m_bytes_in_use = 0;
+    HugePageArena* m_arena = nullptr;
+
+    bool from_arena(const std::uint8_t* slab) const {
+        return m_arena && m_arena->owns(slab);
+    }
+
+    static std::size_t size_class(std::size_t sz) {
+        std::size_t idx = 0;
+        while ((std::size_t(1) << (min_slab_shift + idx)) < sz)
+            idx++;
+        return idx;
+    }
+
+    static std::size_t class_size(std::size_t idx) {
+        return std::size_t(1) << (min_slab_shift + idx);
+    }
+
+  public:
+    BufferPool(std::size_t max_cached_bytes = 64 << 20,
+               HugePageArena* arena = nullptr)
+        : m_max_cached_bytes(max_cached_bytes), m_arena(arena) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ~BufferPool() { trim(0); }
+
+    // returns a slab of at least min_size bytes, its real size is written to
+    // capacity
+    std::uint8_t* acquire(std::size_t min_size, std::size_t& capacity) {
+        const std::size_t idx = size_class(min_size);
+        capacity = class_size(idx);
+        m_bytes_in_use += capacity;
+        if ((idx < m_free.size()) && (!m_free[idx].empty())) {
+            std::uint8_t* out = m_free[idx].back();
+            m_free[idx].pop_back();
+            m_bytes_cached -= capacity;
+            return out;
+        }
+        if (m_arena) {
+            if (auto* out = m_arena->allocate(capacity))
+                return out;
+        }
+        auto* out = static_cast<std::uint8_t*>(std::malloc(capacity));
+        if (!out)
+            throw std::bad_alloc();
+        return out;
+    }
+
+    void release(std::uint8_t* slab, std::size_t capacity) {
+        m_bytes_in_use -= capacity;
+        if ((m_bytes_cached + capacity > m_max_cached_bytes) &&
+            (!from_arena(slab))) {
+            std::free(slab);
+            return;
+        }
+        const std::size_t idx = size_class(capacity);
+        if (idx >= m_free.size())
+            m_free.resize(idx + 1);
+        m_free[idx].push_back(slab);
+        m_bytes_cached += capacity;
+    }
+
+    // frees cached slabs (biggest first) until at most max_cached_bytes are
+    // left
+    void trim(std::size_t max_cached_bytes = 0) {
+        for (std::size_t idx = m_free.size(); idx-- > 0;) {
+            auto& slabs = m_free[idx];
+            for (std::size_t i = slabs.size(); i-- > 0;) {
+                if (m_bytes_cached <= max_cached_bytes)
+                    return;
+                if (from_arena(slabs[i]))
+                    continue;
+                std::free(slabs[i]);
+                slabs[i] = slabs.back();
+                slabs.pop_back();
+                m_bytes_cached -= class_size(idx);
+            }
+        }
+    }
+
+    // fills the pool with count slabs of at least slab_size bytes, so that
+    // connections don't have to allocate when they first need them
+    void reserve(std::size_t slab_size, std::size_t count) {
+        std::vector<std::uint8_t*> slabs;
+        std::size_t capacity = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            slabs.push_back(acquire(slab_size, capacity));
+        }
+        for (auto* slab : slabs) {
+            release(slab, capacity);
+        }
+    }
+
+    void set_max_cached_bytes(std::size_t max_cached_bytes) {
+        m_max_cached_bytes = max_cached_bytes;
+        trim(max_cached_bytes);
+    }
+
+    // bytes sitting in the pool waiting to be reused
+    std::size_t bytes_cached() const { return m_bytes_cached; }
+
+    // bytes currently borrowed by connections
+    std::size_t bytes_in_use() const { return m_bytes_in_use; }
+};
+
+// Bump allocator with the same acquire()/release() as BufferPool, for the
+// buffers of one connection. Slabs are carved out of blocks that are
+// malloc'd as needed (block_size, or bigger for a bigger slab) and nothing is
+// freed until the arena is destroyed, so growing a buffer is a bump and a
+// copy. Handing back the slab at the top of the current block rolls the bump
+// back, anything else is dropped, so it suits buffers that are kept for the
+// life of the connection rather than handed back whenever they are idle.
+class MonotonicArena {
+  public:
+    static constexpr std::size_t default_block_size = 64 << 10;
+    // a client with this as its allocator gets an arena of its own
+    static constexpr bool per_connection = true;
+
+  private:
+    static constexpr std::size_t alignment = 64;
+
+    struct Block {
+        std::uint8_t* data;
+        std::size_t size;
+    };
+    std::vector<Block> m_blocks;
+    // bytes used of the last block
+    std::size_t m_used = 0;
+    std::size_t m_block_size;
+
+    void add_block(std::size_t min_size) {
+        const std::size_t size = std::max(min_size, m_block_size);
+        auto* data = static_cast<std::uint8_t*>(std::malloc(size));
+        if (!data)
+            throw std::bad_alloc();
+        m_blocks.push_back({data, size});
+        m_used = 0;
+    }
+
+  public:
+    MonotonicArena(std::size_t block_size = default_block_size)
+        : m_block_size(block_size) {}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    ~MonotonicArena() {
+        for (auto& block : m_blocks) {
+            std::free(block.data);
+        }
+    }
+
+    std::uint8_t* acquire(std::size_t min_size, std::size_t& capacity) {
+        capacity = (min_size + alignment - 1) & ~(alignment - 1);
+        if (m_blocks.empty() || (m_used + capacity > m_blocks.back().size))
+            add_block(capacity);
+        std::uint8_t* out = m_blocks.back().data + m_used;
+        m_used += capacity;
+        return out;
+    }
+
+    void release(std::uint8_t* slab, std::size_t capacity) {
+        if ((!m_blocks.empty()) &&
+            (slab + capacity == m_blocks.back().data + m_used))
+            m_used -= capacity;
+    }
+
+    // Makes the whole arena free again, keeping only the last block. Every
+    // slab has to be out of use.
+    void reset() {
+        for (std::size_t i = 0; i + 1 < m_blocks.size(); i++) {
+            std::free(m_blocks[i].data);
+        }
+        if (m_blocks.size() > 1)
+            m_blocks.erase(m_blocks.begin(), m_blocks.end() - 1);
+        m_used = 0;
+    }
+
+    // bytes malloc'd for blocks
+    std::size_t bytes_reserved() const {
+        std::size_t total = 0;
+        for (const auto& block : m_blocks) {
+            total += block.size;
+        }
+        return total;
+    }
+};
+
+namespace detail {
+
+// allocators that are meant for a single connection
+template <class Allocator, class = void>
+struct is_per_connection : std::false_type {};
+
+template <class Allocator>
+struct is_per_connection<Allocator,
+                         std::enable_if_t<Allocator::per_connection>>
+    : std::true_type {};
+
+} // namespace detail
+
+// Drop in replacement for wsframe::FrameBuffer whose storage is borrowed
+// from an Allocator (a BufferPool, MonotonicArena or anything else with
+// their acquire()/release()), or malloc'd when it has none, and can be given
+// back with release() whenever the buffer is empty. Growing doesn't zero
+// the new space.
+template <class Allocator = BufferPool> class BasicPooledBuffer {
+  private:
+    std::uint8_t* m_buf = nullptr;
+    std::size_t m_capacity = 0;
+    std::size_t m_ptr = 0;
+    Allocator* m_pool = nullptr;
+
+    std::uint8_t* allocate(std::size_t sz, std::size_t& capacity) {
+        if (m_pool)
+            return m_pool->acquire(sz, capacity);
+        capacity = sz;
+        auto* out = static_cast<std::uint8_t*>(std::malloc(sz));
+        if (!out)
+            throw std::bad_alloc();
+        return out;
+    }
+
+    void deallocate() {
+        if (!m_buf)
+            return;
+        if (m_pool) {
+            m_pool->release(m_buf, m_capacity);
+        } else {
+            std::free(m_buf);
+        }
+        m_buf = nullptr;
+        m_capacity = 0;
+    }
+
+    void grow(std::size_t sz) {
+        // at least double so pushing a byte at a time isn't quadratic
+        sz = std::max(sz, std::max<std::size_t>(m_capacity * 2, 256));
+        std::size_t capacity = 0;
+        std::uint8_t* buf = allocate(sz, capacity);
+        if (m_ptr > 0)
+            std::memcpy(buf, m_buf, m_ptr);
+        deallocate();
+        m_buf = buf;
+        m_capacity = capacity;
+    }
+
+  public:
+    BasicPooledBuffer(Allocator* pool = nullptr) : m_pool(pool) {}
+
+    BasicPooledBuffer(const BasicPooledBuffer&) = delete;
+    BasicPooledBuffer& operator=(const BasicPooledBuffer&) = delete;
+
+    BasicPooledBuffer(BasicPooledBuffer&& other)
+        : m_buf(other.m_buf), m_capacity(other.m_capacity),
+          m_ptr(other.m_ptr), m_pool(other.m_pool) {
+        other.m_buf = nullptr;
+        other.m_capacity = 0;
+        other.m_ptr = 0;
+    }
+
+    BasicPooledBuffer& operator=(BasicPooledBuffer&& other) {
+        deallocate();
+        m_buf = other.m_buf;
+        m_capacity = other.m_capacity;
+        m_ptr = other.m_ptr;
+        m_pool = other.m_pool;
+        other.m_buf = nullptr;
+        other.m_capacity = 0;
+        other.m_ptr = 0;
+        return *this;
+    }
+
+    ~BasicPooledBuffer() { deallocate(); }
+
+    // moves the storage over to a different pool (nullptr for malloc)
+    void set_pool(Allocator* pool) {
+        if (pool == m_pool)
+            return;
+        if (m_ptr == 0) {
+            deallocate();
+            m_pool = pool;
+            return;
+        }
+        std::size_t capacity = 0;
+        std::uint8_t* buf = pool ? pool->acquire(m_ptr, capacity)
+                                 : static_cast<std::uint8_t*>(
+                                       std::malloc(capacity = m_ptr));
+        if (!buf)
+            throw std::bad_alloc();
+        std::memcpy(buf, m_buf, m_ptr);
+        deallocate();
+        m_pool = pool;
+        m_buf = buf;
+        m_capacity = capacity;
+    }
+
+    Allocator* pool() const { return m_pool; }
+
+    // gives the storage back, only if the buffer is empty
+    bool release() {
+        if (m_ptr != 0)
+            return false;
+        deallocate();
+        return true;
+    }
+
+    std::size_t capacity() const { return m_capacity; }
+
+    void reset() { m_ptr = 0; }
+
+    void ensure_fit(std::size_t sz) {
+        if (m_capacity < sz)
+            grow(sz);
+    }
+
+    void ensure_extra_space(std::size_t extra) { ensure_fit(m_ptr + extra); }
+
+    // drops the first n bytes, moving the rest to the front
+    void discard_front(std::size_t n) {
+        if (m_ptr > n)
+            std::memmove(m_buf, m_buf + n, m_ptr - n);
+        m_ptr -= n;
+    }
+
+    // no bounds checking
+    void push_back(std::uint8_t byte) {
+        m_buf[m_ptr] = byte;
+        m_ptr++;
+    }
+
+    // no bounds checking
+    std::uint8_t* get_space(std::size_t sz) {
+        std::uint8_t* out = m_buf + m_ptr;
+        m_ptr += sz;
+        return out;
+    }
+
+    void claim_space(std::size_t sz) { m_ptr += sz; }
+
+    void push_back(std::string_view view) {
+        ensure_extra_space(view.size());
+        std::memcpy(get_space(view.size()), view.data(), view.size());
+    }
+
+    std::uint8_t* head() { return m_buf; }
+    const std::uint8_t* head() const { return m_buf; }
+
+    std::uint8_t* tail() { return m_buf + m_ptr; }
+    const std::uint8_t* tail() const { return m_buf + m_ptr; }
+
+    std::size_t size() const { return m_ptr; }
+
+    std::string_view view() const {
+        return std::string_view((const char*)m_buf, m_ptr);
+    }
+};
+
+using PooledBuffer = BasicPooledBuffer<>;
+
+// when a client gives its buffers back
+struct BufferPolicy {
+    // give receive/send buffers back (to the pool, if there is one) as soon
+    // as there is nothing in them
+    bool release_when_idle = false;
+    // otherwise, only give them back once they have grown past this
+    std::size_t shrink_above = std::numeric_limits<std::size_t>::max();
+    // the connection is closed with 1009 if a message is bigger than this
+    std::uint64_t max_message_size = std::numeric_limits<std::uint64_t>::max();
+};
+
+// bytes of buffer memory a client is holding on to
+struct MemoryUsage {
+    std::size_t receive_buffer = 0;
+    std::size_t send_buffer = 0;
+    std::size_t socket_buffer = 0;
+
+    std::size_t total() const {
+        return receive_buffer + send_buffer + socket_buffer;
+    }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_BUFFER_POOL_HPP_
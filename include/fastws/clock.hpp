@@ -0,0 +1,227 @@
+#ifndef _FASTWS_CLOCK_HPP_
+#define _FASTWS_CLOCK_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define FASTWS_HAS_TSC 1
+#else
+#define FASTWS_HAS_TSC 0
+#endif
+
+// Monotonic nanosecond clock that reads the TSC instead of going through
+// clock_gettime. The TSC rate is calibrated against CLOCK_MONOTONIC_RAW the
+// first time the clock is used, and re-fit every resync_interval_ns so the
+// two don't drift apart. Falls back to CLOCK_MONOTONIC_RAW when the cpu
+// doesn't have an invariant TSC (or isn't x86).
+namespace fastws::clock {
+
+inline std::uint64_t raw_ns() {
+    timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return std::uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// constant rate, and doesn't stop in deep C-states
+inline bool invariant_tsc() {
+#if FASTWS_HAS_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+        return false;
+    __cpuid(0x80000007, eax, ebx, ecx, edx);
+    return edx & (1 << 8);
+#else
+    return false;
+#endif
+}
+
+namespace detail {
+
+// ns = base_ns + ((ticks - base_ticks) * mult) >> shift
+constexpr int shift = 32;
+
+// The conversion is published as a seqlock: resync() makes seq odd while it
+// changes base_ticks, base_ns and mult, readers retry if seq was odd or
+// moved while they read. Every resync re-anchors base_ns/base_ticks at the
+// time it happens, so a new rate only applies from there on and now_ns()
+// doesn't jump back. cal_ticks/cal_ns (the first sample) never change, the
+// rate is fit over everything since.
+struct State {
+    bool tsc = false;
+    std::uint64_t cal_ticks = 0;
+    std::uint64_t cal_ns = 0;
+    std::atomic<std::uint64_t> seq{0};
+    std::atomic<std::uint64_t> base_ticks{0};
+    std::atomic<std::uint64_t> base_ns{0};
+    std::atomic<std::uint64_t> mult{std::uint64_t(1) << shift};
+    std::atomic<std::uint64_t> next_resync{0};
+    std::atomic<bool> resyncing{false};
+
+    State();
+};
+
+inline std::uint64_t read_ticks(bool tsc) {
+#if FASTWS_HAS_TSC
+    if (tsc) {
+        // don't let the read get hoisted above earlier loads
+        _mm_lfence();
+        return __rdtsc();
+    }
+#endif
+    return raw_ns();
+}
+
+// reads the TSC and the raw clock as close together as we can manage
+inline void sample(std::uint64_t& ticks, std::uint64_t& ns) {
+    std::uint64_t best = ~std::uint64_t(0);
+    for (int i = 0; i < 5; i++) {
+        const std::uint64_t before = read_ticks(true);
+        const std::uint64_t now = raw_ns();
+        const std::uint64_t after = read_ticks(true);
+        if (after - before < best) {
+            best = after - before;
+            ticks = before + (after - before) / 2;
+            ns = now;
+        }
+    }
+}
+
+inline State::State() : tsc(invariant_tsc()) {
+    if (!tsc)
+        return;
+    sample(cal_ticks, cal_ns);
+    // spin for a few ms to get a first estimate of the rate
+    std::uint64_t ticks = 0, ns = 0;
+    do {
+        sample(ticks, ns);
+    } while (ns - cal_ns < 5000000);
+    base_ticks.store(cal_ticks, std::memory_order_relaxed);
+    base_ns.store(cal_ns, std::memory_order_relaxed);
+    mult.store((std::uint64_t)(((unsigned __int128)(ns - cal_ns) << shift) /
+                               (ticks - cal_ticks)),
+               std::memory_order_relaxed);
+    next_resync.store(ticks + (ticks - cal_ticks) * 20,
+                      std::memory_order_relaxed);
+}
+
+inline State& state() {
+    static State s;
+    return s;
+}
+
+inline std::uint64_t to_ns(std::uint64_t ticks, std::uint64_t mult) {
+    return (std::uint64_t)(((unsigned __int128)ticks * mult) >> shift);
+}
+
+// ns for a TSC reading taken now (left in t), with a consistent base and
+// rate
+inline std::uint64_t tsc_now_ns(const State& s, std::uint64_t& t) {
+    for (;;) {
+        const std::uint64_t seq = s.seq.load(std::memory_order_acquire);
+        const std::uint64_t base_ticks =
+            s.base_ticks.load(std::memory_order_relaxed);
+        const std::uint64_t base_ns = s.base_ns.load(std::memory_order_relaxed);
+        const std::uint64_t mult = s.mult.load(std::memory_order_relaxed);
+        t = read_ticks(true);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((seq & 1) || (s.seq.load(std::memory_order_relaxed) != seq))
+            continue;
+        // another core's TSC can be a little behind the one that anchored
+        if (t < base_ticks)
+            return base_ns;
+        return base_ns + to_ns(t - base_ticks, mult);
+    }
+}
+
+} // namespace detail
+
+constexpr std::uint64_t resync_interval_ns = 1000000000;
+
+// whether reads come from the TSC (otherwise they are CLOCK_MONOTONIC_RAW)
+inline bool uses_tsc() { return detail::state().tsc; }
+
+// Re-fits the TSC rate to CLOCK_MONOTONIC_RAW over everything since the
+// clock was calibrated, from now on. now_ns() does this by itself every
+// resync_interval_ns, only one thread at a time does the work.
+inline void resync() {
+    auto& s = detail::state();
+    if ((!s.tsc) || s.resyncing.exchange(true, std::memory_order_acquire))
+        return;
+    std::uint64_t ticks = 0, ns = 0;
+    detail::sample(ticks, ns);
+    const std::uint64_t mult =
+        (std::uint64_t)(((unsigned __int128)(ns - s.cal_ns) << detail::shift) /
+                        (ticks - s.cal_ticks));
+
+    const std::uint64_t seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    // the old rate up to here, the new one after
+    const std::uint64_t base_ticks =
+        s.base_ticks.load(std::memory_order_relaxed);
+    const std::uint64_t anchor = std::max(detail::read_ticks(true), base_ticks);
+    s.base_ns.store(s.base_ns.load(std::memory_order_relaxed) +
+                        detail::to_ns(anchor - base_ticks,
+                                      s.mult.load(std::memory_order_relaxed)),
+                    std::memory_order_relaxed);
+    s.base_ticks.store(anchor, std::memory_order_relaxed);
+    s.mult.store(mult, std::memory_order_relaxed);
+    s.seq.store(seq + 2, std::memory_order_release);
+
+    s.next_resync.store(
+        anchor + (((unsigned __int128)resync_interval_ns << detail::shift) /
+                  mult),
+        std::memory_order_relaxed);
+    s.resyncing.store(false, std::memory_order_release);
+}
+
+// Raw counter, only useful as a difference passed to to_ns(). The cheapest
+// thing to read when timing something in a loop.
+inline std::uint64_t ticks() { return detail::read_ticks(uses_tsc()); }
+
+// like ticks(), but waits for everything before it to finish (rdtscp), for
+// the end of a timed section
+inline std::uint64_t ticks_end() {
+#if FASTWS_HAS_TSC
+    if (uses_tsc()) {
+        unsigned int aux;
+        const std::uint64_t out = __rdtscp(&aux);
+        _mm_lfence();
+        return out;
+    }
+#endif
+    return raw_ns();
+}
+
+// converts a difference of ticks() to ns
+inline std::uint64_t to_ns(std::uint64_t ticks) {
+    return detail::to_ns(
+        ticks, detail::state().mult.load(std::memory_order_relaxed));
+}
+
+// ns since some arbitrary point, comparable between threads
+inline std::uint64_t now_ns() {
+    auto& s = detail::state();
+    if (!s.tsc)
+        return raw_ns();
+    std::uint64_t t = 0;
+    const std::uint64_t ns = detail::tsc_now_ns(s, t);
+    if (t >= s.next_resync.load(std::memory_order_relaxed))
+        resync();
+    return ns;
+}
+
+inline double now_ms() { return ((double)now_ns()) / 1000000.0; }
+
+} // namespace fastws::clock
+
+#endif // _FASTWS_CLOCK_HPP_
@@ -0,0 +1,234 @@
+#ifndef _FASTWS_CONNECTION_STATS_HPP_
+#define _FASTWS_CONNECTION_STATS_HPP_
+
+#include "tcp_info.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace fastws {
+
+// A counter with one writer (the thread polling the connection) that any
+// thread can read. Updates are a relaxed load and store rather than a
+// read-modify-write, so they cost the same as on a plain integer.
+class StatCounter {
+  private:
+    std::atomic<std::uint64_t> m_value{0};
+
+  public:
+    void add(std::uint64_t n) {
+        m_value.store(m_value.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+
+    void set(std::uint64_t value) {
+        m_value.store(value, std::memory_order_relaxed);
+    }
+
+    void max(std::uint64_t value) {
+        if (value > m_value.load(std::memory_order_relaxed))
+            m_value.store(value, std::memory_order_relaxed);
+    }
+
+    std::uint64_t load() const {
+        return m_value.load(std::memory_order_relaxed);
+    }
+};
+
+// plain copy of ConnectionStats, see ConnectionStats::snapshot()
+struct ConnectionStatsSnapshot {
+    // per opcode (indexed by its value), bytes are payload bytes
+    std::array<std::uint64_t, 16> frames_in = {};
+    std::array<std::uint64_t, 16> bytes_in = {};
+    std::array<std::uint64_t, 16> frames_out = {};
+    std::array<std::uint64_t, 16> bytes_out = {};
+    std::uint64_t recv_calls = 0;
+    std::uint64_t send_calls = 0;
+    std::uint64_t ioctl_calls = 0;
+    std::uint64_t would_block = 0;
+    std::uint64_t socket_bytes_in = 0;
+    std::uint64_t socket_bytes_out = 0;
+    std::uint64_t partial_frames = 0;
+    std::uint64_t largest_frame_in = 0;
+    std::uint64_t largest_frame_out = 0;
+    std::uint64_t receive_buffer_high_water = 0;
+    std::uint64_t send_buffer_high_water = 0;
+    std::uint64_t ping_rtt_ns = 0;
+    std::uint64_t tcp_samples = 0;
+    std::uint64_t tcp_rtt_us = 0;
+    std::uint64_t tcp_rttvar_us = 0;
+    std::uint64_t tcp_retransmits = 0;
+    std::uint64_t tcp_lost = 0;
+    std::uint64_t tcp_cwnd = 0;
+    std::uint64_t tcp_unacked = 0;
+    std::uint64_t tcp_rcv_space = 0;
+
+    // one "name value" per line, opcodes that were never seen are left out
+    std::string to_text() const {
+        std::string out;
+        for_each([&](const std::string& name, std::uint64_t value) {
+            out += name + " " + std::to_string(value) + "\n";
+        });
+        return out;
+    }
+
+    // a flat JSON object, with the same names as to_text()
+    std::string to_json() const {
+        std::string out = "{";
+        for_each([&](const std::string& name, std::uint64_t value) {
+            if (out.size() > 1)
+                out += ",";
+            out += "\"" + name + "\":" + std::to_string(value);
+        });
+        return out + "}";
+    }
+
+    // f(name, value) for every value
+    template <class F> void for_each(F&& f) const {
+        static const char* const opcodes[16] = {
+            "continuation", "text", "binary", nullptr, nullptr, nullptr,
+            nullptr,        nullptr, "close", "ping",  "pong"};
+        const auto per_opcode = [&](const char* prefix, const auto& frames,
+                                    const auto& bytes) {
+            for (std::size_t i = 0; i < 16; i++) {
+                if ((frames[i] == 0) && (bytes[i] == 0))
+                    continue;
+                const std::string name =
+                    opcodes[i] ? opcodes[i] : "opcode" + std::to_string(i);
+                f(std::string(prefix) + "_frames_" + name, frames[i]);
+                f(std::string(prefix) + "_bytes_" + name, bytes[i]);
+            }
+        };
+        per_opcode("in", frames_in, bytes_in);
+        per_opcode("out", frames_out, bytes_out);
+        f("recv_calls", recv_calls);
+        f("send_calls", send_calls);
+        f("ioctl_calls", ioctl_calls);
+        f("would_block", would_block);
+        f("socket_bytes_in", socket_bytes_in);
+        f("socket_bytes_out", socket_bytes_out);
+        f("partial_frames", partial_frames);
+        f("largest_frame_in", largest_frame_in);
+        f("largest_frame_out", largest_frame_out);
+        f("receive_buffer_high_water", receive_buffer_high_water);
+        f("send_buffer_high_water", send_buffer_high_water);
+        f("ping_rtt_ns", ping_rtt_ns);
+        f("tcp_samples", tcp_samples);
+        f("tcp_rtt_us", tcp_rtt_us);
+        f("tcp_rttvar_us", tcp_rttvar_us);
+        f("tcp_retransmits", tcp_retransmits);
+        f("tcp_lost", tcp_lost);
+        f("tcp_cwnd", tcp_cwnd);
+        f("tcp_unacked", tcp_unacked);
+        f("tcp_rcv_space", tcp_rcv_space);
+    }
+};
+
+// Counters for one connection, written by the thread polling it and readable
+// from any other (e.g. a monitor thread calling snapshot()). It is aligned to
+// and padded out to whole cache lines, so it doesn't share one with whatever
+// is around it.
+struct alignas(64) ConnectionStats {
+    std::array<StatCounter, 16> frames_in;
+    std::array<StatCounter, 16> bytes_in;
+    std::array<StatCounter, 16> frames_out;
+    std::array<StatCounter, 16> bytes_out;
+    // syscalls on the socket, and the reads/writes that found it not ready
+    StatCounter recv_calls;
+    StatCounter send_calls;
+    StatCounter ioctl_calls;
+    StatCounter would_block;
+    // what went over the socket (TLS records, frame headers and all)
+    StatCounter socket_bytes_in;
+    StatCounter socket_bytes_out;
+    // reads that picked up in the middle of a frame
+    StatCounter partial_frames;
+    StatCounter largest_frame_in;
+    StatCounter largest_frame_out;
+    // most bytes held in the receive buffer, and the biggest frame sent
+    StatCounter receive_buffer_high_water;
+    StatCounter send_buffer_high_water;
+    // the last ping's RTT, and the last TCP_INFO sample (see TcpInfo)
+    StatCounter ping_rtt_ns;
+    StatCounter tcp_samples;
+    StatCounter tcp_rtt_us;
+    StatCounter tcp_rttvar_us;
+    StatCounter tcp_retransmits;
+    StatCounter tcp_lost;
+    StatCounter tcp_cwnd;
+    StatCounter tcp_unacked;
+    StatCounter tcp_rcv_space;
+
+    void record_frame_in(std::uint8_t opcode, std::uint64_t payload) {
+        frames_in[opcode & 0x0F].add(1);
+        bytes_in[opcode & 0x0F].add(payload);
+        largest_frame_in.max(payload);
+    }
+
+    // a serialized frame, from the client
+    void record_frame_out(std::string_view frame) {
+        if (frame.size() < 2)
+            return;
+        const std::uint8_t len = frame[1] & 0x7F;
+        const std::size_t header = 2 + ((frame[1] & 0x80) ? 4 : 0) +
+                                   ((len == 126) ? 2 : (len == 127) ? 8 : 0);
+        const std::uint64_t payload = frame.size() - header;
+        frames_out[frame[0] & 0x0F].add(1);
+        bytes_out[frame[0] & 0x0F].add(payload);
+        largest_frame_out.max(payload);
+        send_buffer_high_water.max(frame.size());
+    }
+
+    void record_tcp_info(const TcpInfo& info) {
+        tcp_rtt_us.set(info.rtt_us);
+        tcp_rttvar_us.set(info.rttvar_us);
+        tcp_retransmits.set(info.retransmits);
+        tcp_lost.set(info.lost);
+        tcp_cwnd.set(info.cwnd);
+        tcp_unacked.set(info.unacked);
+        tcp_rcv_space.set(info.rcv_space);
+        tcp_samples.add(1);
+    }
+
+    // Each counter is read on its own, so a snapshot taken while the
+    // connection is busy can be a frame ahead in one counter compared to
+    // another.
+    ConnectionStatsSnapshot snapshot() const {
+        ConnectionStatsSnapshot out;
+        for (std::size_t i = 0; i < 16; i++) {
+            out.frames_in[i] = frames_in[i].load();
+            out.bytes_in[i] = bytes_in[i].load();
+            out.frames_out[i] = frames_out[i].load();
+            out.bytes_out[i] = bytes_out[i].load();
+        }
+        out.recv_calls = recv_calls.load();
+        out.send_calls = send_calls.load();
+        out.ioctl_calls = ioctl_calls.load();
+        out.would_block = would_block.load();
+        out.socket_bytes_in = socket_bytes_in.load();
+        out.socket_bytes_out = socket_bytes_out.load();
+        out.partial_frames = partial_frames.load();
+        out.largest_frame_in = largest_frame_in.load();
+        out.largest_frame_out = largest_frame_out.load();
+        out.receive_buffer_high_water = receive_buffer_high_water.load();
+        out.send_buffer_high_water = send_buffer_high_water.load();
+        out.ping_rtt_ns = ping_rtt_ns.load();
+        out.tcp_samples = tcp_samples.load();
+        out.tcp_rtt_us = tcp_rtt_us.load();
+        out.tcp_rttvar_us = tcp_rttvar_us.load();
+        out.tcp_retransmits = tcp_retransmits.load();
+        out.tcp_lost = tcp_lost.load();
+        out.tcp_cwnd = tcp_cwnd.load();
+        out.tcp_unacked = tcp_unacked.load();
+        out.tcp_rcv_space = tcp_rcv_space.load();
+        return out;
+    }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_CONNECTION_STATS_HPP_
@@ -0,0 +1,435 @@
+#ifndef _FASTWS_CORO_HPP_
+#define _FASTWS_CORO_HPP_
+
+// C++20 coroutine interface to WSClient, only available when compiling
+// with coroutine support (-std=c++20)
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include "fastws.hpp"
+
+#include <algorithm>
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#define FASTWS_HAS_COROUTINES 1
+
+namespace fastws {
+
+namespace detail {
+
+// Recycles coroutine frames. Sizes are rounded up to 64 bytes and freed
+// frames are kept on per-size free lists (per thread), so starting a task
+// in steady state doesn't touch the heap. Frames over 4 KB aren't pooled.
+class FramePool {
+  private:
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t classes = 64;
+
+    struct Node {
+        Node* next;
+    };
+
+    std::array<Node*, classes> m_free = {};
+
+    static std::size_t size_class(std::size_t size) {
+        return (size + granularity - 1) / granularity;
+    }
+
+  public:
+    FramePool() {}
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    ~FramePool() {
+        for (Node* node : m_free) {
+            while (node) {
+                Node* next = node->next;
+                ::operator delete(node);
+                node = next;
+            }
+        }
+    }
+
+    static FramePool& local() {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    void* allocate(std::size_t size) {
+        const std::size_t c = size_class(size);
+        if (c >= classes)
+            return ::operator new(size);
+        if (Node* node = m_free[c]) {
+            m_free[c] = node->next;
+            return node;
+        }
+        return ::operator new(c * granularity);
+    }
+
+    void deallocate(void* ptr, std::size_t size) {
+        const std::size_t c = size_class(size);
+        if (c >= classes) {
+            ::operator delete(ptr);
+            return;
+        }
+        Node* node = static_cast<Node*>(ptr);
+        node->next = m_free[c];
+        m_free[c] = node;
+    }
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> m_continuation = std::noop_coroutine();
+    std::exception_ptr m_exception;
+
+    static void* operator new(std::size_t size) {
+        return FramePool::local().allocate(size);
+    }
+
+    static void operator delete(void* ptr, std::size_t size) {
+        FramePool::local().deallocate(ptr, size);
+    }
+
+    // hands straight back to whoever was awaiting the task
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <class Promise>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().m_continuation;
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { m_exception = std::current_exception(); }
+};
+
+template <class T> struct Promise;
+
+} // namespace detail
+
+// Lazily started coroutine. Awaiting a task runs it (with symmetric
+// transfer, so chains of tasks don't grow the stack), a task that nothing
+// awaits is started with start() and then driven by whatever it awaits.
+template <class T = void> class [[nodiscard]] Task {
+  public:
+    using promise_type = detail::Promise<T>;
+
+  private:
+    std::coroutine_handle<promise_type> m_handle;
+
+  public:
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle) {}
+
+    Task(Task&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    // runs the task up to its first suspension
+    void start() { m_handle.resume(); }
+
+    bool done() const { return (!m_handle) || m_handle.done(); }
+
+    // rethrows whatever the task threw
+    T result() {
+        auto& promise = m_handle.promise();
+        if (promise.m_exception)
+            std::rethrow_exception(promise.m_exception);
+        if constexpr (!std::is_void_v<T>)
+            return std::move(*promise.m_value);
+    }
+
+    auto operator co_await() noexcept {
+        struct Awaiter {
+            Task& task;
+            bool await_ready() noexcept { return task.done(); }
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                task.m_handle.promise().m_continuation = awaiting;
+                return task.m_handle;
+            }
+            T await_resume() { return task.result(); }
+        };
+        return Awaiter{*this};
+    }
+};
+
+namespace detail {
+
+template <class T> struct Promise : PromiseBase {
+    std::optional<T> m_value;
+
+    Task<T> get_return_object() {
+        return Task<T>(std::coroutine_handle<Promise>::from_promise(*this));
+    }
+
+    template <class U> void return_value(U&& value) {
+        m_value.emplace(std::forward<U>(value));
+    }
+};
+
+template <> struct Promise<void> : PromiseBase {
+    Task<void> get_return_object() {
+        return Task<void>(
+            std::coroutine_handle<Promise>::from_promise(*this));
+    }
+
+    void return_void() {}
+};
+
+} // namespace detail
+
+// A message from CoClient::receive(). The payload is only valid until the
+// coroutine next suspends (on receive() or anything else), so copy it if
+// you want to keep it around.
+struct Message {
+    wsframe::Frame::Opcode opcode = wsframe::Frame::Opcode::UNKNOWN;
+    bool fin = true;
+    std::string_view payload;
+
+    // the connection is closed, nothing more will come
+    bool closed() const { return opcode == wsframe::Frame::Opcode::CLOSE; }
+};
+
+// Awaitable WSClient. It is driven by the same poll loop as a callback
+// client: a coroutine waiting in receive() is resumed from inside poll()
+// with a view of the frame straight out of the receive buffer, so there is
+// no copy unless a message arrives while nothing is waiting, in which case
+// it is queued (in buffers that are reused). One coroutine receives at a
+// time; sends complete immediately.
+template <template <bool> class SocketType> class CoClient {
+  private:
+    struct Handler {
+        using Client = WSClient<SocketType, Handler>;
+        CoClient* owner;
+
+        void on_close(Client&, bool) { owner->m_closed = true; }
+        void on_text(Client&, wsframe::Frame frame) { owner->deliver(frame); }
+        void on_binary(Client&, wsframe::Frame frame) {
+            owner->deliver(frame);
+        }
+        void on_continuation(Client&, wsframe::Frame frame) {
+            owner->deliver(frame);
+        }
+    };
+
+    struct Queued {
+        wsframe::Frame::Opcode opcode;
+        bool fin;
+        std::string payload;
+    };
+
+    std::string m_host;
+    std::string m_path;
+    long m_port;
+    std::string m_extra_headers;
+    int m_connection_timeout;
+    int m_ping_frequency;
+    int m_ping_timeout;
+    SocketOptions m_socket_options;
+
+    // ring of messages nobody was waiting for, slots keep their capacity
+    // and don't move when it grows
+    std::vector<std::unique_ptr<Queued>> m_queue;
+    std::size_t m_head = 0;
+    std::size_t m_queued = 0;
+    // the front slot is what the last receive() returned
+    bool m_holding = false;
+
+    Message m_current;
+    bool m_closed = false;
+    std::coroutine_handle<> m_waiter;
+
+    Handler m_handler{this};
+    std::optional<typename Handler::Client> m_client;
+
+    void deliver(const wsframe::Frame& frame) {
+        if (m_waiter) {
+            m_current = {frame.opcode, frame.fin, frame.payload};
+            std::exchange(m_waiter, nullptr).resume();
+            return;
+        }
+        if (m_queued == m_queue.size()) {
+            // grow, keeping the ring in order from the start
+            std::rotate(m_queue.begin(), m_queue.begin() + m_head,
+                        m_queue.end());
+            m_head = 0;
+            m_queue.resize(std::max<std::size_t>(8, m_queue.size() * 2));
+            for (std::size_t i = m_queued; i < m_queue.size(); i++) {
+                m_queue[i] = std::make_unique<Queued>();
+            }
+        }
+        auto& slot = *m_queue[(m_head + m_queued) % m_queue.size()];
+        slot.opcode = frame.opcode;
+        slot.fin = frame.fin;
+        slot.payload.assign(frame.payload);
+        m_queued++;
+    }
+
+    // A close is only passed on once the client's poll has returned, as the
+    // coroutine is then free to reconnect, which replaces the client.
+    ConnectionStatus after_poll(ConnectionStatus status) {
+        if (m_closed && m_waiter) {
+            m_current = {wsframe::Frame::Opcode::CLOSE, true, {}};
+            std::exchange(m_waiter, nullptr).resume();
+        }
+        return status;
+    }
+
+    // sets m_current without waiting, if there is anything
+    bool take() {
+        if (m_holding) {
+            m_head = (m_head + 1) % m_queue.size();
+            m_queued--;
+            m_holding = false;
+        }
+        if (m_queued > 0) {
+            const auto& slot = *m_queue[m_head];
+            m_current = {slot.opcode, slot.fin, slot.payload};
+            m_holding = true;
+            return true;
+        }
+        if (m_closed || !m_client) {
+            m_current = {wsframe::Frame::Opcode::CLOSE, true, {}};
+            return true;
+        }
+        return false;
+    }
+
+  public:
+    CoClient(const std::string& host, const std::string& path,
+             const long port = 443, const std::string& extra_headers = "",
+             int connection_timeout = 10 /*seconds*/,
+             int ping_frequency = 60 /*seconds*/,
+             int ping_timeout = 10 /*seconds*/,
+             const SocketOptions& socket_options = {})
+        : m_host(host), m_path(path), m_port(port),
+          m_extra_headers(extra_headers),
+          m_connection_timeout(connection_timeout),
+          m_ping_frequency(ping_frequency), m_ping_timeout(ping_timeout),
+          m_socket_options(socket_options) {}
+
+    CoClient(const CoClient&) = delete;
+    CoClient& operator=(const CoClient&) = delete;
+
+    // the client calls on_close on the way out, nobody is resumed by it
+    ~CoClient() {
+        m_waiter = nullptr;
+        m_client.reset();
+    }
+
+    // Connects and does the upgrade. This happens in await_resume (the
+    // handshake is the same blocking one the WSClient constructor does), so
+    // a failure throws into the awaiting coroutine.
+    auto connect() {
+        struct Awaiter {
+            CoClient& client;
+            bool await_ready() noexcept { return true; }
+            void await_suspend(std::coroutine_handle<>) noexcept {}
+            void await_resume() {
+                // the old client's on_close goes first
+                client.m_client.reset();
+                client.m_closed = false;
+                client.m_client.emplace(
+                    client.m_handler, client.m_host, client.m_path,
+                    client.m_port, client.m_extra_headers,
+                    client.m_connection_timeout, client.m_ping_frequency,
+                    client.m_ping_timeout, client.m_socket_options);
+            }
+        };
+        return Awaiter{*this};
+    }
+
+    // the next message, or one with closed() set once the connection is
+    // done with
+    auto receive() {
+        struct Awaiter {
+            CoClient& client;
+            bool await_ready() { return client.take(); }
+            void await_suspend(std::coroutine_handle<> awaiting) {
+                client.m_waiter = awaiting;
+            }
+            Message await_resume() { return client.m_current; }
+        };
+        return Awaiter{*this};
+    }
+
+    std::suspend_never send_text(std::string_view payload) {
+        m_client->send_text(payload);
+        return {};
+    }
+
+    std::suspend_never send_binary(std::string_view payload) {
+        m_client->send_binary(payload);
+        return {};
+    }
+
+    // starts closing, receive() returns a closed message once it is done
+    void close(int timeout = 10 /*seconds*/, std::uint16_t code = 1000) {
+        if (m_client)
+            m_client->close(timeout, code);
+    }
+
+    bool closed() const { return (!m_client) || m_client->closed(); }
+
+    // the poll loop, as for WSClient, waiting coroutines are resumed inside
+    // (or straight after, for the end of the connection)
+    ConnectionStatus poll(const int max_reads = 4) {
+        return m_client ? after_poll(m_client->poll(max_reads))
+                        : ConnectionStatus::UNKNOWN;
+    }
+
+    ConnectionStatus poll_for(std::uint64_t budget_ns) {
+        return m_client ? after_poll(m_client->poll_for(budget_ns))
+                        : ConnectionStatus::UNKNOWN;
+    }
+
+    ConnectionStatus drain() {
+        return m_client ? after_poll(m_client->drain())
+                        : ConnectionStatus::UNKNOWN;
+    }
+
+    // the underlying client, for everything else (timer wheel, stats, ...),
+    // only once connected
+    typename Handler::Client& client() { return *m_client; }
+};
+
+using TLSCoClient = CoClient<SSLSocketWrapper>;
+
+using NoTLSCoClient = CoClient<SocketWrapper>;
+
+} // namespace fastws
+
+#endif // __cpp_impl_coroutine
+
+#endif // _FASTWS_CORO_HPP_
@@ -3,15 +3,35 @@
 #ifndef _FASTWS_FASTWS_HPP_
 #define _FASTWS_FASTWS_HPP_
 
+#include "buffer_pool.hpp"
+#include "clock.hpp"
+#include "connection_stats.hpp"
+#include "features.hpp"
+#include "fixed_buffer.hpp"
+#include "frame_factory.hpp"
 #include "handshake.hpp"
-#include "plf_nanotimer.h"
+#include "idle_strategy.hpp"
+#include "low_latency.hpp"
+#include "payload.hpp"
+#include "rtt_stats.hpp"
 #include "socket_wrapper.hpp"
+#include "tcp_info.hpp"
+#include "streaming_parser.hpp"
+#include "timer_wheel.hpp"
+#include "utf8.hpp"
 #include "wsframe/wsframe.hpp"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
-#include <iostream>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace fastws {
 
@@ -21,24 +41,179 @@ enum ConnectionStatus {
     CLOSED_BY_CLIENT,
     PING_TIMED_OUT,
     FAILED,
+    INVALID_PAYLOAD,
+    MESSAGE_TOO_BIG,
+    CLOSING,
     UNKNOWN
 };
 
-template <template <bool> class SocketType, class FrameHandler> class WSClient {
+// The frames handed to on_batch, in the order they arrived. The payloads
+// point into the receive buffer and are only valid during the call.
+class FrameBatch {
   private:
+    const wsframe::Frame* m_frames;
+    std::size_t m_size;
+
+  public:
+    FrameBatch(const wsframe::Frame* frames, std::size_t size)
+        : m_frames(frames), m_size(size) {}
+
+    const wsframe::Frame* begin() const { return m_frames; }
+    const wsframe::Frame* end() const { return m_frames + m_size; }
+    const wsframe::Frame* data() const { return m_frames; }
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const wsframe::Frame& operator[](std::size_t i) const {
+        return m_frames[i];
+    }
+    const wsframe::Frame& front() const { return m_frames[0]; }
+    const wsframe::Frame& back() const { return m_frames[m_size - 1]; }
+};
+
+namespace detail {
+
+// The rest of the callbacks are optional too, events the handler has no
+// method for are dropped.
+template <class FrameHandler, class Client, class = void>
+struct has_on_open : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_open<FrameHandler, Client,
+                   std::void_t<decltype(std::declval<FrameHandler&>().on_open(
+                       std::declval<Client&>()))>> : std::true_type {};
+
+template <class FrameHandler, class Client, class = void>
+struct has_on_close : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_close<
+    FrameHandler, Client,
+    std::void_t<decltype(std::declval<FrameHandler&>().on_close(
+        std::declval<Client&>(), std::declval<bool>()))>> : std::true_type {};
+
+template <class FrameHandler, class Client, class = void>
+struct has_on_text : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_text<FrameHandler, Client,
+                   std::void_t<decltype(std::declval<FrameHandler&>().on_text(
+                       std::declval<Client&>(),
+                       std::declval<wsframe::Frame>()))>> : std::true_type {};
+
+template <class FrameHandler, class Client, class = void>
+struct has_on_binary : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_binary<
+    FrameHandler, Client,
+    std::void_t<decltype(std::declval<FrameHandler&>().on_binary(
+        std::declval<Client&>(), std::declval<wsframe::Frame>()))>>
+    : std::true_type {};
+
+template <class FrameHandler, class Client, class = void>
+struct has_on_continuation : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_continuation<
+    FrameHandler, Client,
+    std::void_t<decltype(std::declval<FrameHandler&>().on_continuation(
+        std::declval<Client&>(), std::declval<wsframe::Frame>()))>>
+    : std::true_type {};
+
+// handlers that define on_frame_chunk get large frames streamed to them
+template <class FrameHandler, class Client, class = void>
+struct has_on_frame_chunk : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_frame_chunk<
+    FrameHandler, Client,
+    std::void_t<decltype(std::declval<FrameHandler&>().on_frame_chunk(
+        std::declval<Client&>(), std::declval<wsframe::Frame>(),
+        std::declval<std::string_view>(), std::declval<bool>()))>>
+    : std::true_type {};
+
+// handlers that define on_handshake can queue messages to go out with the
+// upgrade request
+template <class FrameHandler, class Client, class = void>
+struct has_on_handshake : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_handshake<
+    FrameHandler, Client,
+    std::void_t<decltype(std::declval<FrameHandler&>().on_handshake(
+        std::declval<Client&>()))>> : std::true_type {};
+
+// handlers that define on_batch get the data frames in batches instead of
+// through on_text/on_binary/on_continuation
+template <class FrameHandler, class Client, class = void>
+struct has_on_batch : std::false_type {};
+
+template <class FrameHandler, class Client>
+struct has_on_batch<
+    FrameHandler, Client,
+    std::void_t<decltype(std::declval<FrameHandler&>().on_batch(
+        std::declval<Client&>(), std::declval<FrameBatch>()))>>
+    : std::true_type {};
+
+} // namespace detail
+
+template <template <bool> class SocketType, class FrameHandler,
+          class Features = DefaultFeatures>
+class WSClient {
+  private:
+    static_assert(!Features::pings || Features::control_frames,
+                  "pings need control_frames for the pongs");
+
+    static constexpr bool streaming =
+        detail::has_on_frame_chunk<FrameHandler, WSClient>::value;
+    static constexpr bool pipelining =
+        detail::has_on_handshake<FrameHandler, WSClient>::value;
+    static constexpr bool batching =
+        detail::has_on_batch<FrameHandler, WSClient>::value;
+    static constexpr bool bounded =
+        Features::max_payload != std::numeric_limits<std::uint64_t>::max();
+    static_assert(!(bounded && streaming),
+                  "on_frame_chunk is for frames too big to buffer");
+    static constexpr bool retainable = Features::retainable_payloads;
+    static_assert(!(bounded && retainable),
+                  "retained payloads live in slabs, not a fixed buffer");
+
+    using Allocator = typename Features::allocator;
+    static constexpr bool own_allocator =
+        detail::is_per_connection<Allocator>::value;
+
+    using ReceiveBuffer = std::conditional_t<
+        bounded, FixedBuffer<fixed_receive_capacity(Features::max_payload)>,
+        std::conditional_t<retainable, SlabBuffer,
+                           BasicPooledBuffer<Allocator>>>;
+    using SendBuffer = std::conditional_t<
+        bounded, FixedBuffer<fixed_send_capacity(Features::max_payload)>,
+        BasicPooledBuffer<Allocator>>;
+
     FrameHandler& m_handler;
     std::string m_host;
     std::string m_path;
     long m_port;
     std::string m_extra_headers;
+    SocketOptions m_socket_options;
     SocketType<false> m_socket;
-    wsframe::FrameParser m_parser;
-    wsframe::FrameFactory m_factory;
+    // declared before the buffers, which it has to outlive
+    std::conditional_t<own_allocator, Allocator, std::tuple<>> m_allocator;
+    BasicStreamingFrameParser<ReceiveBuffer, Features::unmasking,
+                              Features::max_payload>
+        m_parser;
+    BasicFrameFactory<SendBuffer, Features::max_payload> m_factory;
+    BufferPolicy m_buffer_policy;
     ConnectionStatus m_status = ConnectionStatus::UNKNOWN;
     bool m_connection_open = false;
+    int m_last_poll_frames = 0;
+    // frames sent from on_handshake, they go out behind the upgrade request
+    bool m_pipelining = false;
+    std::string m_pipelined;
+    // data frames parsed since the last on_batch
+    std::vector<wsframe::Frame> m_batch;
 
     bool connect(int timeout = 10 /*seconds*/) {
-        m_socket = SocketType<false>(m_host, m_port);
         auto host = m_host;
         if (m_port != 443) {
             host += ":" + std::to_string(m_port);
@@ -46,27 +221,77 @@ template <template <bool> class SocketType, class FrameHandler> class WSClient {
         auto request = fastws::build_websocket_handshake_request(
             host, m_path, fastws::generate_sec_websocket_key(),
             m_extra_headers);
-        m_socket.send(request);
+        // Messages the handler wants sent first are framed now and written
+        // straight after the request, so they are already on the server by
+        // the time it has upgraded. They don't wait for the 101.
+        if constexpr (pipelining) {
+            m_pipelining = true;
+            m_handler.on_handshake(*this);
+            m_pipelining = false;
+            request += m_pipelined;
+            m_pipelined.clear();
+            m_pipelined.shrink_to_fit();
+        }
+        // the upgrade goes out as TLS early data when resuming a session
+        // that allows it, saving a round trip
+        m_socket = SocketType<false>(m_host, m_port, Resolver::global(),
+                                     m_socket_options, request,
+                                     timeout * 1000);
+        if constexpr (Features::instrumentation)
+            m_socket.set_stats(&m_stats);
         std::string response = "";
+        std::size_t header_end = std::string::npos;
         for (int i = 0; i < timeout * 10; i++) {
             response += m_socket.read(4096);
-            if (response.find("\r\n\r\n") != std::string::npos) {
+            header_end = response.find("\r\n\r\n");
+            if (header_end != std::string::npos) {
                 break;
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (!m_socket.has_pending()) {
+                pollfd pfd = {m_socket.fd(), POLLIN, 0};
+                ::poll(&pfd, 1, 100);
+            }
         }
         m_connection_open = response.find("HTTP/1.1 101") !=
                             std::string::npos;
+        // the server may have sent frames right behind the response
+        if (m_connection_open && (header_end + 4 < response.size())) {
+            m_parser.frame_buffer().push_back(
+                std::string_view(response).substr(header_end + 4));
+        }
+        m_socket.shrink();
         if (m_connection_open) {
             m_status = ConnectionStatus::HEALTHY;
-            m_handler.on_open(*this);
+            if constexpr (detail::has_on_open<FrameHandler, WSClient>::value)
+                m_handler.on_open(*this);
         } else {
             m_status = ConnectionStatus::FAILED;
         }
         return m_connection_open;
     }
 
-    void send(std::string_view frame) { m_socket.send(frame); }
+    void send(std::string_view frame) {
+        if constexpr (Features::instrumentation)
+            m_stats.record_frame_out(frame);
+        if (m_pipelining) {
+            m_pipelined += frame;
+            return;
+        }
+        m_socket.send(frame);
+        auto& send_buffer = m_factory.buffer();
+        if (should_release(send_buffer.capacity())) {
+            send_buffer.reset();
+            send_buffer.release();
+        }
+    }
+
+    bool should_release(std::size_t capacity) const {
+        // the connection's own arena couldn't reuse what it got back
+        if constexpr (own_allocator)
+            return false;
+        return (capacity > 0) && (m_buffer_policy.release_when_idle ||
+                                  capacity > m_buffer_policy.shrink_above);
+    }
 
     void send_pong(std::string_view payload) {
         send(m_factory.pong(true, payload));
@@ -76,36 +301,426 @@ template <template <bool> class SocketType, class FrameHandler> class WSClient {
         send(m_factory.close(true, payload));
     }
 
+    void send_close(std::uint16_t code) {
+        const std::array<char, 2> payload = {static_cast<char>(code >> 8),
+                                             static_cast<char>(code & 0xFF)};
+        send_close(std::string_view(payload.data(), payload.size()));
+    }
+
     void send_ping(std::string_view payload = {}) {
         send(m_factory.ping(true, payload));
     }
 
-    plf::nanotimer m_ping_timer;
-    bool m_waiting_for_ping = false;
-    const double m_ping_every;   // ms
-    const double m_ping_timeout; // ms
-    double m_last_rtt = 0;
+    void notify_close(bool success) {
+        if constexpr (detail::has_on_close<FrameHandler, WSClient>::value)
+            m_handler.on_close(*this, success);
+    }
+
+    // closes the connection without waiting for the server, used when we
+    // get something we can't deal with
+    void fail(ConnectionStatus status, std::uint16_t code) {
+        // already closed (the parser stays failed, so this comes up on
+        // every poll after the first failure)
+        if (!m_connection_open && (m_status != ConnectionStatus::CLOSING))
+            return;
+        // only one CLOSE goes out, even if we were already closing
+        const bool close_sent = m_status == ConnectionStatus::CLOSING;
+        m_connection_open = false;
+        m_status = status;
+        m_close_event.cancel();
+        if (!close_sent)
+            send_close(code);
+        notify_close(false);
+    }
+
+    // set by close(), when to give up waiting for the server's CLOSE
+    std::uint64_t m_close_deadline = 0; // ns, on fastws::clock
+    Timer m_close_event;
+
+    void finish_close(bool success) {
+        m_close_event.cancel();
+        m_status = ConnectionStatus::CLOSED_BY_CLIENT;
+        notify_close(success);
+    }
+
+    void schedule_close_event() {
+        m_wheel->schedule(m_close_event, m_close_deadline / 1000000);
+    }
 
-    void handle_pong(std::string_view payload = {}) {
-        m_last_rtt = m_ping_timer.get_elapsed_ms();
-        m_ping_timer.start();
-        m_waiting_for_ping = false;
+    static void on_close_event(void* ctx) {
+        auto& client = *static_cast<WSClient*>(ctx);
+        if (client.m_status == ConnectionStatus::CLOSING)
+            client.finish_close(false);
     }
 
-    void update_ping() {
-        if (m_waiting_for_ping) {
-            if (m_ping_timer.get_elapsed_ms() > m_ping_timeout) {
-                m_connection_open = false;
-                m_status = ConnectionStatus::PING_TIMED_OUT;
-                std::cout << "ping timed out" << std::endl;
+    bool m_validate_utf8 = false;
+    bool m_in_text_message = false;
+    Utf8Validator m_utf8;
+
+    // validates text frames and continuations of text messages, first/last
+    // are whether this is the start/end of the frame when it is streamed
+    bool check_utf8(const wsframe::Frame& frame, bool first = true,
+                    bool last = true) {
+        // control frames can come between the fragments of a message, they
+        // aren't part of it
+        if (static_cast<std::uint8_t>(frame.opcode) & 0x08)
+            return true;
+        if (frame.opcode == wsframe::Frame::Opcode::TEXT) {
+            if (first)
+                m_utf8.reset();
+        } else if (!m_in_text_message) {
+            return true;
+        }
+        m_in_text_message = !(frame.fin && last);
+        return (frame.fin && last) ? m_utf8.finish(frame.payload)
+                                   : m_utf8.update(frame.payload);
+    }
+
+    // Pings carry the time they were sent and a sequence number, so a pong
+    // gives the RTT by itself and several pings can be in flight. The send
+    // times of the ones in flight are kept, to time out the oldest and to
+    // ignore pongs we didn't ask for.
+    static constexpr std::uint64_t max_pings_in_flight = 16;
+    std::array<std::uint64_t, max_pings_in_flight> m_ping_sent = {};
+    std::uint64_t m_ping_seq = 0; // last ping sent
+    std::uint64_t m_pong_seq = 0; // last ping answered
+    std::uint64_t m_next_ping = 0; // ns, on fastws::clock
+    double m_ping_every;   // ms
+    double m_ping_timeout; // ms
+    RttStats m_rtt;
+    // written by the polling thread, read from anywhere through stats()
+    std::conditional_t<Features::instrumentation, ConnectionStats,
+                       std::tuple<>>
+        m_stats;
+    // payload of the frame being streamed, so far
+    std::uint64_t m_streamed_bytes = 0;
+    TcpInfo m_tcp_info;
+
+    // when attached to a wheel, the next ping or the pong deadline
+    TimerWheel* m_wheel = nullptr;
+    Timer m_ping_event;
+    // TCP_INFO is sampled on connecting and then every m_tcp_info_every
+    // (0 for never), on its own timer whether or not pings are on
+    std::uint64_t m_tcp_info_every = 1000000000; // ns
+    std::uint64_t m_next_tcp_info = 0;           // ns, on fastws::clock
+    Timer m_tcp_info_event;
+
+    std::uint64_t pings_in_flight() const { return m_ping_seq - m_pong_seq; }
+
+    // when the oldest ping in flight times out
+    std::uint64_t pong_deadline() const {
+        return m_ping_sent[(m_pong_seq + 1) % max_pings_in_flight] +
+               (std::uint64_t)(m_ping_timeout * 1e6);
+    }
+
+    void handle_pong(std::string_view payload) {
+        std::uint64_t sent, seq;
+        if (payload.size() != sizeof(sent) + sizeof(seq))
+            return;
+        std::memcpy(&sent, payload.data(), sizeof(sent));
+        std::memcpy(&seq, payload.data() + sizeof(sent), sizeof(seq));
+        if ((seq <= m_pong_seq) || (seq > m_ping_seq) ||
+            (m_ping_sent[seq % max_pings_in_flight] != sent))
+            return;
+        // pongs come back in order, so anything before it was lost
+        m_pong_seq = seq;
+        m_rtt.record(clock::now_ns() - sent);
+        if constexpr (Features::instrumentation)
+            m_stats.ping_rtt_ns.set(m_rtt.last());
+    }
+
+    // the server has gone quiet, there's no point waiting for a CLOSE back
+    void ping_timed_out() {
+        m_connection_open = false;
+        m_status = ConnectionStatus::PING_TIMED_OUT;
+        notify_close(false);
+    }
+
+    void start_ping(std::uint64_t now) {
+        m_next_ping = now + (std::uint64_t)(m_ping_every * 1e6);
+        // the oldest is overdue by now and about to time out
+        if (pings_in_flight() == max_pings_in_flight)
+            return;
+        m_ping_seq++;
+        m_ping_sent[m_ping_seq % max_pings_in_flight] = now;
+        std::array<char, 16> payload;
+        std::memcpy(payload.data(), &now, sizeof(now));
+        std::memcpy(payload.data() + sizeof(now), &m_ping_seq,
+                    sizeof(m_ping_seq));
+        send_ping(std::string_view(payload.data(), payload.size()));
+    }
+
+    // nothing handled by the last poll and nothing waiting to be read
+    bool idle() const {
+        return (m_last_poll_frames == 0) && (!m_socket.has_pending()) &&
+               (m_socket.available() == 0);
+    }
+
+    // Pings only go out while the connection is idle, so they never hold up
+    // a data frame, unless they have already been put off for a whole
+    // interval. Returns whether a ping is due but was put off.
+    bool update_ping(std::uint64_t now) {
+        if ((pings_in_flight() > 0) && (now >= pong_deadline())) {
+            ping_timed_out();
+            return false;
+        }
+        if (now < m_next_ping)
+            return false;
+        if (idle() ||
+            (now - m_next_ping >= (std::uint64_t)(m_ping_every * 1e6))) {
+            start_ping(now);
+            return false;
+        }
+        return true;
+    }
+
+    // the wheel runs on fastws::clock too, so deadlines can be measured
+    // from when pings went out rather than the wheel's cached time. A ping
+    // that was put off is retried on the next tick.
+    void schedule_ping_event(std::uint64_t now, bool deferred = false) {
+        std::uint64_t at = deferred ? now + 1000000 : m_next_ping;
+        if (pings_in_flight() > 0)
+            at = std::min(at, pong_deadline());
+        m_wheel->schedule(m_ping_event, at / 1000000);
+    }
+
+    static void on_ping_event(void* ctx) {
+        auto& client = *static_cast<WSClient*>(ctx);
+        if (!client.m_connection_open)
+            return;
+        const std::uint64_t now = clock::now_ns();
+        const bool deferred = client.update_ping(now);
+        if (client.m_connection_open)
+            client.schedule_ping_event(now, deferred);
+    }
+
+    // Like pings, a due sample waits for a poll that handled nothing, unless
+    // it has been put off for a whole interval. Returns whether it was put
+    // off.
+    bool update_tcp_info(std::uint64_t now) {
+        if ((m_tcp_info_every == 0) || (now < m_next_tcp_info))
+            return false;
+        if ((m_last_poll_frames > 0) &&
+            (now - m_next_tcp_info < m_tcp_info_every))
+            return true;
+        sample_tcp_info();
+        return false;
+    }
+
+    void schedule_tcp_info_event(std::uint64_t now, bool deferred = false) {
+        m_wheel->schedule(m_tcp_info_event,
+                          (deferred ? now + 1000000 : m_next_tcp_info) /
+                              1000000);
+    }
+
+    static void on_tcp_info_event(void* ctx) {
+        auto& client = *static_cast<WSClient*>(ctx);
+        if (!client.m_connection_open || (client.m_tcp_info_every == 0))
+            return;
+        const std::uint64_t now = clock::now_ns();
+        client.schedule_tcp_info_event(now, client.update_tcp_info(now));
+    }
+
+    static bool is_data(const wsframe::Frame& frame) {
+        return (frame.opcode == wsframe::Frame::Opcode::TEXT) ||
+               (frame.opcode == wsframe::Frame::Opcode::BINARY) ||
+               (Features::fragments &&
+                (frame.opcode == wsframe::Frame::Opcode::CONTINUATION));
+    }
+
+    // the payloads are still in the buffer, as nothing has been compacted
+    // since they were parsed
+    void deliver_batch() {
+        if (m_batch.empty())
+            return;
+        m_handler.on_batch(*this, FrameBatch(m_batch.data(), m_batch.size()));
+        m_batch.clear();
+    }
+
+    // everything parsed so far has been handled, so the rest of the buffer
+    // can be moved down before reading more into it
+    void compact() {
+        if constexpr (batching)
+            deliver_batch();
+        m_parser.compact();
+    }
+
+    void record_frame_in(const wsframe::Frame& frame) {
+        const auto opcode = static_cast<std::uint8_t>(frame.opcode);
+        if (!m_parser.streaming()) {
+            m_stats.record_frame_in(opcode, frame.payload.size());
+            return;
+        }
+        // a streamed frame counts once all of it is in
+        m_streamed_bytes += frame.payload.size();
+        if (m_parser.last_chunk()) {
+            m_stats.record_frame_in(opcode, m_streamed_bytes);
+            m_streamed_bytes = 0;
+        }
+    }
+
+    // hands a frame (or chunk) to the handler, false if it ended the
+    // connection
+    bool handle_frame(wsframe::Frame frame) {
+        if constexpr (Features::instrumentation)
+            record_frame_in(frame);
+        // Data frames are held back for on_batch. Anything else (chunks,
+        // control frames, a failure) hands over what is held first, so the
+        // handler still sees everything in order.
+        if constexpr (batching) {
+            if (!m_parser.streaming() && is_data(frame)) {
+                if (m_validate_utf8 && !check_utf8(frame)) {
+                    deliver_batch();
+                    fail(ConnectionStatus::INVALID_PAYLOAD, 1007);
+                    return false;
+                }
+                m_batch.push_back(frame);
+                return true;
             }
-        } else {
-            if (m_ping_timer.get_elapsed_ms() > m_ping_every) {
-                m_waiting_for_ping = true;
-                m_ping_timer.start();
-                send_ping();
+            deliver_batch();
+        }
+        if constexpr (streaming) {
+            if (m_parser.streaming()) {
+                if (m_validate_utf8 &&
+                    !check_utf8(frame, m_parser.first_chunk(),
+                                m_parser.last_chunk())) {
+                    fail(ConnectionStatus::INVALID_PAYLOAD, 1007);
+                    return false;
+                }
+                auto chunk = frame.payload;
+                frame.payload = {};
+                m_handler.on_frame_chunk(*this, frame, chunk,
+                                         m_parser.last_chunk());
+                return true;
             }
         }
+        if (m_validate_utf8 && !check_utf8(frame)) {
+            fail(ConnectionStatus::INVALID_PAYLOAD, 1007);
+            return false;
+        }
+        switch (frame.opcode) {
+        case wsframe::Frame::Opcode::TEXT:
+            if constexpr (detail::has_on_text<FrameHandler, WSClient>::value)
+                m_handler.on_text(*this, std::move(frame));
+            break;
+        case wsframe::Frame::Opcode::BINARY:
+            if constexpr (detail::has_on_binary<FrameHandler, WSClient>::value)
+                m_handler.on_binary(*this, std::move(frame));
+            break;
+        case wsframe::Frame::Opcode::PING:
+            if constexpr (Features::control_frames)
+                send_pong(frame.payload);
+            break;
+        case wsframe::Frame::Opcode::PONG:
+            if constexpr (Features::pings)
+                handle_pong(frame.payload);
+            break;
+        case wsframe::Frame::Opcode::CLOSE:
+            // the reply to ours
+            if (m_status == ConnectionStatus::CLOSING) {
+                finish_close(true);
+                return false;
+            }
+            m_connection_open = false;
+            m_status = ConnectionStatus::CLOSED_BY_SERVER;
+            send_close();
+            notify_close(true);
+            return false;
+        default:
+            if constexpr (!Features::fragments) {
+                fail(ConnectionStatus::FAILED, 1003);
+                return false;
+            } else if constexpr (detail::has_on_continuation<
+                                     FrameHandler, WSClient>::value) {
+                m_handler.on_continuation(*this, std::move(frame));
+            }
+            break;
+        }
+        return true;
+    }
+
+    ConnectionStatus finish_poll() {
+        if constexpr (batching)
+            deliver_batch();
+        if (m_parser.failed()) {
+            fail(ConnectionStatus::MESSAGE_TOO_BIG, 1009);
+            return m_status;
+        }
+        if (should_release(m_parser.frame_buffer().capacity()))
+            m_parser.release_if_idle();
+        if (m_wheel)
+            return m_status;
+        if (m_status == ConnectionStatus::CLOSING) {
+            if (clock::now_ns() >= m_close_deadline)
+                finish_close(false);
+        } else if (m_connection_open &&
+                   (Features::pings || (m_tcp_info_every != 0))) {
+            const std::uint64_t now = clock::now_ns();
+            if constexpr (Features::pings)
+                update_ping(now);
+            if (m_connection_open)
+                update_tcp_info(now);
+        }
+        return m_status;
+    }
+
+    // one read of whatever is waiting on the socket, false if there was
+    // nothing (without the syscall when the kernel says it is empty)
+    bool read_available() {
+        const std::size_t available = m_socket.available();
+        if (available == 0)
+            return false;
+        compact();
+        const std::size_t size = m_parser.read_size(
+            std::clamp<std::size_t>(available, 1024, max_read_size));
+        if (size == 0)
+            return false;
+        return read_into_buffer(size);
+    }
+
+    // what poll() reads, whether or not anything is waiting
+    bool read_chunk() {
+        compact();
+        return read_into_buffer(m_parser.read_size(1024));
+    }
+
+    bool read_into_buffer(std::size_t size) {
+        auto& buffer = m_parser.frame_buffer();
+        if constexpr (Features::instrumentation) {
+            const bool partial = m_parser.unparsed() > 0;
+            if (!m_socket.read_into(buffer, size))
+                return false;
+            if (partial)
+                m_stats.partial_frames.add(1);
+            m_stats.receive_buffer_high_water.max(buffer.size());
+            return true;
+        } else {
+            return m_socket.read_into(buffer, size);
+        }
+    }
+
+    template <bool timed>
+    ConnectionStatus poll_available(std::uint64_t deadline_ns) {
+        m_last_poll_frames = 0;
+        bool new_data = false;
+        do {
+            // everything already buffered first
+            for (auto parsed_frame = m_parser.update(new_data);
+                 parsed_frame.has_value();
+                 parsed_frame = m_parser.update(false)) {
+                if (!handle_frame(parsed_frame.value()))
+                    return m_status;
+                m_last_poll_frames++;
+                if constexpr (timed) {
+                    if (clock::now_ns() >= deadline_ns)
+                        return finish_poll();
+                }
+            }
+            if (m_parser.failed())
+                break;
+            new_data = read_available();
+        } while (new_data);
+        return finish_poll();
     }
 
   public:
@@ -114,45 +729,71 @@ template <template <bool> class SocketType, class FrameHandler> class WSClient {
              const std::string& extra_headers = "",
              int connection_timeout = 10 /*seconds*/,
              int ping_frequency = 60 /*seconds*/,
-             int ping_timeout = 10 /*seconds*/)
+             int ping_timeout = 10 /*seconds*/,
+             const SocketOptions& socket_options = {})
         : m_handler(handler), m_host(host), m_path(path), m_port(port),
-          m_extra_headers(extra_headers),
+          m_extra_headers(extra_headers), m_socket_options(socket_options),
+          m_close_event(&WSClient::on_close_event, this),
           m_ping_every(((double)ping_frequency) * 1000.0),
-          m_ping_timeout(((double)ping_timeout) * 1000.0) {
+          m_ping_timeout(((double)ping_timeout) * 1000.0),
+          m_ping_event(&WSClient::on_ping_event, this),
+          m_tcp_info_event(&WSClient::on_tcp_info_event, this) {
+        if constexpr (streaming) {
+            m_parser.set_max_buffered_payload(default_max_buffered_payload);
+        }
+        // compacted once per read rather than once per frame
+        m_parser.set_defer_compaction(true);
+        if constexpr (own_allocator)
+            use_buffer_pool(m_allocator);
         if (!connect(connection_timeout)) {
             throw std::runtime_error("Failed to connect to ws server");
         }
-        m_waiting_for_ping = true;
-        m_ping_timer.start();
-        send_ping();
+        if constexpr (Features::pings)
+            start_ping(clock::now_ns());
+        sample_tcp_info();
     }
 
     ConnectionStatus status() const { return m_status; }
 
-    bool close(int timeout = 10 /*seconds*/) {
+    const SocketOptions& socket_options() const { return m_socket_options; }
+
+    // Starts closing the connection: sends CLOSE with code and returns
+    // straight away with status CLOSING. poll() keeps handling frames until
+    // the server's CLOSE comes back (on_close(true)) or timeout passes
+    // (on_close(false)), and the status becomes CLOSED_BY_CLIENT.
+    ConnectionStatus close(int timeout = 10 /*seconds*/,
+                           std::uint16_t code = 1000) {
         if (!m_connection_open)
-            return true;
-        poll();
-        m_parser.clear();
-        send_close();
-        m_status = ConnectionStatus::CLOSED_BY_CLIENT;
+            return m_status;
         m_connection_open = false;
-        bool success = false;
-        for (int i = 0; i < timeout * 10; i++) {
-            auto frame = m_parser.update(m_socket.read(1024));
-            if (frame) {
-                if (frame->opcode == wsframe::Frame::Opcode::CLOSE) {
-                    success = true;
-                    break;
-                }
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
-        m_handler.on_close(*this, success);
-        return success;
+        m_ping_event.cancel();
+        m_tcp_info_event.cancel();
+        send_close(code);
+        m_status = ConnectionStatus::CLOSING;
+        m_close_deadline =
+            clock::now_ns() + (std::uint64_t)timeout * 1000000000;
+        if (m_wheel)
+            schedule_close_event();
+        return m_status;
+    }
+
+    // true once the connection is done with, i.e. not HEALTHY or CLOSING
+    bool closed() const {
+        return (m_status != ConnectionStatus::HEALTHY) &&
+               (m_status != ConnectionStatus::CLOSING);
     }
 
-    ~WSClient() { close(); }
+    // doesn't wait for the server, close() and poll until closed() for that
+    ~WSClient() {
+        if (m_connection_open) {
+            m_connection_open = false;
+            send_close(1000);
+            m_status = ConnectionStatus::CLOSED_BY_CLIENT;
+            notify_close(false);
+        } else if (m_status == ConnectionStatus::CLOSING) {
+            finish_close(false);
+        }
+    }
 
     void send_text(std::string_view payload) {
         send(m_factory.text(true, true, payload));
@@ -162,52 +803,211 @@ template <template <bool> class SocketType, class FrameHandler> class WSClient {
         send(m_factory.binary(true, true, payload));
     }
 
+    // Handles every complete frame already in the buffer, then reads 1024
+    // bytes for more, up to max_reads times. Everything parsed between two
+    // reads goes to on_batch together.
     ConnectionStatus poll(const int max_reads = 4) {
-        int count_reads = 0;
-        for (auto parsed_frame = m_parser.update(
-                 m_socket.read_into(m_parser.frame_buffer(), 1024));
-             parsed_frame.has_value();
-             parsed_frame = m_parser.update(
-                 m_socket.read_into(m_parser.frame_buffer(), 1024))) {
-            auto frame = parsed_frame.value();
-            switch (frame.opcode) {
-            case wsframe::Frame::Opcode::TEXT:
-                m_handler.on_text(*this, std::move(frame));
-                break;
-            case wsframe::Frame::Opcode::BINARY:
-                m_handler.on_binary(*this, std::move(frame));
-                break;
-            case wsframe::Frame::Opcode::PING:
-                send_pong(frame.payload);
-                break;
-            case wsframe::Frame::Opcode::PONG:
-                handle_pong(frame.payload);
+        m_last_poll_frames = 0;
+        bool new_data = false;
+        for (int reads = 0;; reads++) {
+            for (auto parsed_frame = m_parser.update(new_data);
+                 parsed_frame.has_value();
+                 parsed_frame = m_parser.update(false)) {
+                if (!handle_frame(parsed_frame.value()))
+                    return m_status;
+                m_last_poll_frames++;
+            }
+            if (m_parser.failed() || (reads >= max_reads))
                 break;
-            case wsframe::Frame::Opcode::CLOSE:
-                m_connection_open = false;
-                m_status = ConnectionStatus::CLOSED_BY_SERVER;
-                send_close();
-                m_handler.on_close(*this, true);
-                return m_status;
-            default:
-                m_handler.on_continuation(*this, std::move(frame));
+            new_data = read_chunk();
+            if (!new_data)
                 break;
-            }
-            count_reads++;
-            if (count_reads >= max_reads)break;
         }
-        update_ping();
-        return m_status;
+        return finish_poll();
+    }
+
+    // Handles everything the socket has for us, for at most budget_ns.
+    // Reads are sized to what is waiting (up to max_read_size) and every
+    // complete frame in the buffer is handled before the next read, so a
+    // burst is cleared in a few syscalls. Stops early once the budget is
+    // spent, leaving the rest for the next call, so one busy client can't
+    // starve the others polled from the same thread.
+    ConnectionStatus poll_for(std::uint64_t budget_ns) {
+        return poll_available<true>(clock::now_ns() + budget_ns);
+    }
+
+    // like poll_for, without a budget
+    ConnectionStatus drain() { return poll_available<false>(0); }
+
+    // ms, of the last pong
+    double last_rtt() const { return (double)m_rtt.last() / 1000000.0; }
+
+    // ns, from every pong since connecting
+    const RttStats& rtt_stats() const { return m_rtt; }
+
+    // Reads TCP_INFO for the socket now (one getsockopt()), and records it
+    // in stats() with instrumentation on. This happens every
+    // set_tcp_info_interval() anyway, and the next sample is counted from
+    // here.
+    const TcpInfo& sample_tcp_info() {
+        if (read_tcp_info(m_socket.fd(), m_tcp_info)) {
+            if constexpr (Features::instrumentation)
+                m_stats.record_tcp_info(m_tcp_info);
+        }
+        m_next_tcp_info = clock::now_ns() + m_tcp_info_every;
+        return m_tcp_info;
+    }
+
+    // how often TCP_INFO is sampled (1s by default), 0 to only sample on
+    // connecting and when sample_tcp_info() is called
+    void set_tcp_info_interval(std::chrono::milliseconds every) {
+        m_tcp_info_every = (std::uint64_t)every.count() * 1000000;
+        m_tcp_info_event.cancel();
+        if (m_tcp_info_every == 0)
+            return;
+        const std::uint64_t now = clock::now_ns();
+        m_next_tcp_info = std::min(m_next_tcp_info, now + m_tcp_info_every);
+        if (m_wheel && m_connection_open)
+            schedule_tcp_info_event(now);
+    }
+
+    // the last TCP_INFO sample, not valid() until there has been one
+    const TcpInfo& tcp_info() const { return m_tcp_info; }
+
+    // ms, the kernel's smoothed RTT as of the last sample (compare with
+    // last_rtt(), which includes the server)
+    double last_tcp_rtt() const { return (double)m_tcp_info.rtt_us / 1000.0; }
+
+    // The connection's counters, which another thread (e.g. a monitor) can
+    // snapshot() while this one polls. They live as long as the client.
+    const ConnectionStats& stats() const {
+        static_assert(Features::instrumentation,
+                      "Features need instrumentation");
+        return m_stats;
+    }
+
+    // frames (or chunks) handled by the last poll(), i.e. the work to pass
+    // to an idle strategy
+    int last_poll_frames() const { return m_last_poll_frames; }
+
+    // bytes already read off the socket (by TLS) that poll() hasn't seen
+    // yet, polling again won't need the socket to be readable
+    bool has_buffered_data() const { return m_socket.has_pending(); }
+
+    // the socket, for an idle strategy (or anything else) to wait on
+    int fd() const { return m_socket.fd(); }
+
+    // Hands ping scheduling, the pong timeout and TCP_INFO sampling over to
+    // a wheel shared with other clients, so poll() no longer reads the
+    // clock. The wheel has to be polled from the same thread as the client
+    // and has to outlive it.
+    void attach(TimerWheel& wheel) {
+        m_wheel = &wheel;
+        if (m_status == ConnectionStatus::CLOSING)
+            schedule_close_event();
+        if constexpr (Features::pings) {
+            if (m_connection_open)
+                schedule_ping_event(clock::now_ns());
+        }
+        if (m_connection_open && (m_tcp_info_every != 0))
+            schedule_tcp_info_event(clock::now_ns());
+    }
+
+    // goes back to checking the timers in poll()
+    void detach() {
+        m_ping_event.cancel();
+        m_tcp_info_event.cancel();
+        m_close_event.cancel();
+        m_wheel = nullptr;
+    }
+
+    TimerWheel* timer_wheel() const { return m_wheel; }
+
+    // ms precision replacement for the constructor's ping_frequency and
+    // ping_timeout, takes effect from the next ping
+    void set_ping_interval(std::chrono::milliseconds every,
+                           std::chrono::milliseconds timeout) {
+        static_assert(Features::pings, "pings are turned off");
+        m_ping_every = (double)every.count();
+        m_ping_timeout = (double)timeout.count();
+        m_next_ping = m_ping_sent[m_ping_seq % max_pings_in_flight] +
+                      (std::uint64_t)(m_ping_every * 1e6);
+        if (m_wheel && m_connection_open)
+            schedule_ping_event(clock::now_ns());
+    }
+
+    // largest single read poll_for()/drain() will do
+    static constexpr std::size_t max_read_size = 1 << 16;
+
+    // only used when the handler has on_frame_chunk
+    static constexpr std::size_t default_max_buffered_payload = 1 << 16;
+
+    // text/binary/continuation frames with payloads bigger than this are
+    // passed to on_frame_chunk as they arrive instead of being buffered
+    void set_max_buffered_payload(std::size_t max_buffered_payload) {
+        static_assert(streaming, "FrameHandler needs on_frame_chunk");
+        m_parser.set_max_buffered_payload(max_buffered_payload);
+    }
+
+    // borrow receive/send buffers from a pool (or whatever the features'
+    // allocator is) shared with other clients, it has to outlive the client
+    void use_buffer_pool(Allocator& pool) {
+        if constexpr (!retainable)
+            m_parser.frame_buffer().set_pool(&pool);
+        m_factory.buffer().set_pool(&pool);
     }
 
-    double last_rtt() const { return m_last_rtt; }
+    // take receive slabs from pool rather than SlabPool::global(), it has to
+    // outlive the client and every Payload retained from it
+    void use_slab_pool(SlabPool& pool) {
+        static_assert(retainable, "Features need retainable_payloads");
+        m_parser.frame_buffer().set_pool(&pool);
+    }
+
+    // Keeps a payload (or any part of one) handed to the handler valid after
+    // the callback returns, without copying it: the Payload shares the slab
+    // it was received into. Only call it from a callback, with a view of
+    // what it was passed.
+    Payload retain(std::string_view payload) {
+        static_assert(retainable, "Features need retainable_payloads");
+        return m_parser.frame_buffer().retain(payload);
+    }
+
+    // allocates the receive/send buffers up front (from the pool, if there
+    // is one), so they don't have to grow on the hot path
+    void reserve_buffers(std::size_t receive_buffer, std::size_t send_buffer) {
+        m_parser.frame_buffer().ensure_fit(receive_buffer);
+        m_factory.buffer().ensure_fit(send_buffer);
+    }
+
+    void set_buffer_policy(const BufferPolicy& policy) {
+        m_buffer_policy = policy;
+        m_parser.set_max_message_size(policy.max_message_size);
+    }
+
+    const BufferPolicy& buffer_policy() const { return m_buffer_policy; }
+
+    MemoryUsage memory_usage() const {
+        MemoryUsage out;
+        out.receive_buffer = m_parser.frame_buffer().capacity();
+        out.send_buffer = m_factory.buffer().capacity();
+        out.socket_buffer = m_socket.buffer_capacity();
+        return out;
+    }
+
+    // check that text messages are valid UTF-8 before passing them to the
+    // handler, closing the connection with 1007 if not
+    void validate_utf8(bool enable = true) {
+        m_validate_utf8 = enable;
+        m_in_text_message = false;
+    }
 };
 
-template <class FrameHandler>
-using TLSClient = WSClient<SSLSocketWrapper, FrameHandler>;
+template <class FrameHandler, class Features = DefaultFeatures>
+using TLSClient = WSClient<SSLSocketWrapper, FrameHandler, Features>;
 
-template <class FrameHandler>
-using NoTLSClient = WSClient<SocketWrapper, FrameHandler>;
+template <class FrameHandler, class Features = DefaultFeatures>
+using NoTLSClient = WSClient<SocketWrapper, FrameHandler, Features>;
 
 } // namespace fastws
 
@@ -0,0 +1,60 @@
+#ifndef _FASTWS_FEATURES_HPP_
+#define _FASTWS_FEATURES_HPP_
+
+#include <cstdint>
+#include <limits>
+
+namespace fastws {
+
+class BufferPool;
+
+// Which parts of WSClient get compiled in, passed as its last template
+// argument. A feature that is off generates no code on the poll path, rather
+// than being skipped at run time. To turn some off, derive from
+// DefaultFeatures and hide the ones to change:
+//
+//     struct MyFeatures : fastws::DefaultFeatures {
+//         static constexpr bool pings = false;
+//     };
+struct DefaultFeatures {
+    // keepalive pings and the pong timeout (needs control_frames)
+    static constexpr bool pings = true;
+    // answering the server's pings and handling pongs. CLOSE is always
+    // handled.
+    static constexpr bool control_frames = true;
+    // continuation frames, without it one closes the connection with 1003
+    static constexpr bool fragments = true;
+    // unmasking masked frames, which a server shouldn't send
+    static constexpr bool unmasking = true;
+    // the connection's counters (see WSClient::stats()). Ping RTTs are
+    // recorded whenever pings are on.
+    static constexpr bool instrumentation = true;
+    // Largest frame payload, in either direction. When set, the receive and
+    // send buffers are fixed size and inline (about 3 * max_payload bytes in
+    // all, see fixed_buffer.hpp), a bigger frame from the server closes the
+    // connection with 1009, and sending a bigger one throws.
+    static constexpr std::uint64_t max_payload =
+        std::numeric_limits<std::uint64_t>::max();
+    // Where the receive/send buffers come from (see buffer_pool.hpp). With
+    // a BufferPool they are malloc'd until use_buffer_pool() is called. A
+    // MonotonicArena is per connection, every client gets its own.
+    using allocator = BufferPool;
+    // Receive into reference counted slabs (see payload.hpp), so handlers
+    // can keep a payload past the callback with WSClient::retain() instead
+    // of copying it. The receive buffer then comes from a SlabPool, not the
+    // allocator.
+    static constexpr bool retainable_payloads = false;
+};
+
+// for servers that only send whole, unmasked messages and keep the
+// connection alive by themselves
+struct LeanFeatures : DefaultFeatures {
+    static constexpr bool pings = false;
+    static constexpr bool fragments = false;
+    static constexpr bool unmasking = false;
+    static constexpr bool instrumentation = false;
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_FEATURES_HPP_
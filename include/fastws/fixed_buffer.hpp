@@ -0,0 +1,117 @@
+#ifndef _FASTWS_FIXED_BUFFER_HPP_
+#define _FASTWS_FIXED_BUFFER_HPP_
+
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace fastws {
+
+// Drop in replacement for PooledBuffer with N bytes of inline storage, for
+// connections whose frames have a known maximum size. It never allocates
+// and can't grow: asking for more than N bytes throws std::length_error, so
+// whoever fills it has to stay within free_space(). The pool calls are
+// accepted and ignored.
+template <std::size_t N> class FixedBuffer {
+  private:
+    // left uninitialized, like a malloc'd buffer
+    std::uint8_t m_buf[N];
+    std::size_t m_ptr = 0;
+
+  public:
+    static constexpr std::size_t fixed_capacity = N;
+
+    template <class Allocator = BufferPool>
+    FixedBuffer(Allocator* = nullptr) {}
+
+    template <class Allocator> void set_pool(Allocator*) {}
+
+    // the storage is part of the buffer, there is nothing to give back
+    bool release() { return false; }
+
+    std::size_t capacity() const { return N; }
+
+    void reset() { m_ptr = 0; }
+
+    void ensure_fit(std::size_t sz) {
+        if (sz > N)
+            throw std::length_error("FixedBuffer of " + std::to_string(N) +
+                                    " bytes can't fit " + std::to_string(sz));
+    }
+
+    void ensure_extra_space(std::size_t extra) { ensure_fit(m_ptr + extra); }
+
+    // drops the first n bytes, moving the rest to the front
+    void discard_front(std::size_t n) {
+        if (m_ptr > n)
+            std::memmove(m_buf, m_buf + n, m_ptr - n);
+        m_ptr -= n;
+    }
+
+    // how much more can go in
+    std::size_t free_space() const { return N - m_ptr; }
+
+    // no bounds checking
+    void push_back(std::uint8_t byte) {
+        m_buf[m_ptr] = byte;
+        m_ptr++;
+    }
+
+    // no bounds checking
+    std::uint8_t* get_space(std::size_t sz) {
+        std::uint8_t* out = m_buf + m_ptr;
+        m_ptr += sz;
+        return out;
+    }
+
+    void claim_space(std::size_t sz) { m_ptr += sz; }
+
+    void push_back(std::string_view view) {
+        ensure_extra_space(view.size());
+        std::memcpy(get_space(view.size()), view.data(), view.size());
+    }
+
+    std::uint8_t* head() { return m_buf; }
+    const std::uint8_t* head() const { return m_buf; }
+
+    std::uint8_t* tail() { return m_buf + m_ptr; }
+    const std::uint8_t* tail() const { return m_buf + m_ptr; }
+
+    std::size_t size() const { return m_ptr; }
+
+    std::string_view view() const {
+        return std::string_view((const char*)m_buf, m_ptr);
+    }
+};
+
+namespace detail {
+
+template <class Buffer> struct is_fixed_buffer : std::false_type {};
+
+template <std::size_t N>
+struct is_fixed_buffer<FixedBuffer<N>> : std::true_type {};
+
+} // namespace detail
+
+// Receive buffer size for frames of at most max_payload bytes: room for two
+// whole frames (headers included), so behind a partial frame there is always
+// at least a frame's worth of space to read into.
+constexpr std::size_t fixed_receive_capacity(std::uint64_t max_payload) {
+    return std::max<std::size_t>(2 * (max_payload + 14), 4096);
+}
+
+// send buffer size, one frame (which can be a 125 byte control frame)
+constexpr std::size_t fixed_send_capacity(std::uint64_t max_payload) {
+    return std::max<std::size_t>(max_payload, 125) + 14;
+}
+
+} // namespace fastws
+
+#endif // _FASTWS_FIXED_BUFFER_HPP_
@@ -0,0 +1,127 @@
+#ifndef _FASTWS_FRAME_FACTORY_HPP_
+#define _FASTWS_FRAME_FACTORY_HPP_
+
+#include "buffer_pool.hpp"
+#include "mask.hpp"
+#include "wsframe/wsframe.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace fastws {
+
+// Same interface as wsframe::FrameFactory, but serializes into a Buffer we
+// control (see PooledBuffer) so the send buffer can be given back when idle.
+// With a MaxPayload, bigger payloads throw and the length encodings that
+// aren't needed aren't compiled in (control frames can always be 125 bytes).
+template <class Buffer,
+          std::uint64_t MaxPayload = std::numeric_limits<std::uint64_t>::max()>
+class BasicFrameFactory {
+  private:
+    static constexpr std::uint64_t frame_limit =
+        std::max<std::uint64_t>(MaxPayload, 125);
+
+    Buffer m_buf;
+    wsframe::XorShift128Plus m_random;
+
+  public:
+    BasicFrameFactory(Buffer buf = Buffer())
+        : m_buf(std::move(buf)),
+          m_random(wsframe::device_random(), wsframe::device_random()) {}
+
+    std::string_view construct(bool fin, wsframe::Frame::Opcode opcode,
+                               bool mask, std::string_view payload) {
+        const std::uint64_t payload_length = payload.size();
+        if constexpr (frame_limit < std::numeric_limits<std::uint64_t>::max()) {
+            if (payload_length > frame_limit) {
+                throw std::runtime_error("Payload should be <= " +
+                                         std::to_string(frame_limit));
+            }
+        }
+        m_buf.reset();
+        m_buf.ensure_fit(payload_length + 14);
+
+        // fin bit + 3 rsv bits + opcode
+        m_buf.push_back(
+            ((fin ? 0x80 : 0x00) | (static_cast<std::uint8_t>(opcode) & 0x0F)));
+
+        const std::uint8_t mask_bit = mask ? 0x80 : 0x00;
+        if ((frame_limit <= 125) || (payload_length < 126U)) {
+            m_buf.push_back(mask_bit |
+                            static_cast<std::uint8_t>(payload_length));
+        } else if ((frame_limit <= 0xFFFF) || (payload_length <= 0xFFFFU)) {
+            m_buf.push_back(mask_bit | 126U);
+            m_buf.push_back(
+                static_cast<std::uint8_t>((payload_length >> 8) & 0xFFU));
+            m_buf.push_back(static_cast<std::uint8_t>(payload_length & 0xFFU));
+        } else {
+            m_buf.push_back(mask_bit | 127U);
+            std::uint8_t* ptr = m_buf.get_space(8);
+            for (int i = 7; i >= 0; i--) {
+                *ptr = static_cast<std::uint8_t>((payload_length >> (8 * i)) &
+                                                 0xFFU);
+                ptr++;
+            }
+        }
+
+        const auto* payload_data = (const std::uint8_t*)payload.data();
+        if (mask) {
+            const std::uint64_t rnd = m_random.next64();
+            std::uint8_t* key = m_buf.get_space(4);
+            std::memcpy(key, &rnd, 4);
+            mask_payload(m_buf.get_space(payload_length), payload_data,
+                         payload_length, key);
+        } else if (payload_length > 0) {
+            std::memcpy(m_buf.get_space(payload_length), payload_data,
+                        payload_length);
+        }
+        return m_buf.view();
+    }
+
+    std::string_view text(bool fin, bool mask, std::string_view payload) {
+        return construct(fin, wsframe::Frame::Opcode::TEXT, mask, payload);
+    }
+
+    std::string_view binary(bool fin, bool mask, std::string_view payload) {
+        return construct(fin, wsframe::Frame::Opcode::BINARY, mask, payload);
+    }
+
+    std::string_view ping(bool mask, std::string_view payload) {
+        if (payload.size() > 125) {
+            throw std::runtime_error(
+                "Payload should be <= 125 for ping frames");
+        }
+        return construct(true, wsframe::Frame::Opcode::PING, mask, payload);
+    }
+
+    std::string_view pong(bool mask, std::string_view payload) {
+        if (payload.size() > 125) {
+            throw std::runtime_error(
+                "Payload should be <= 125 for pong frames");
+        }
+        return construct(true, wsframe::Frame::Opcode::PONG, mask, payload);
+    }
+
+    std::string_view close(bool mask, std::string_view payload) {
+        if (payload.size() > 125) {
+            throw std::runtime_error(
+                "Payload should be <= 125 for close frames");
+        }
+        return construct(true, wsframe::Frame::Opcode::CLOSE, mask, payload);
+    }
+
+    Buffer& buffer() { return m_buf; }
+    const Buffer& buffer() const { return m_buf; }
+};
+
+using FrameFactory = BasicFrameFactory<PooledBuffer>;
+
+} // namespace fastws
+
+#endif // _FASTWS_FRAME_FACTORY_HPP_
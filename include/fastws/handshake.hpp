@@ -4,9 +4,13 @@
 #include <openssl/bio.h>
 #include <openssl/buffer.h>
 #include <openssl/evp.h>
+#include <openssl/sha.h>
 
+#include <algorithm>
+#include <cctype>
 #include <random>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace fastws {
@@ -60,6 +64,63 @@ inline std::string build_websocket_handshake_request(
     return request;
 }
 
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key (RFC 6455 section 4.2.2)
+inline std::string websocket_accept_key(std::string_view key) {
+    static constexpr std::string_view guid =
+        "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    std::string input(key);
+    input += guid;
+    unsigned char sha[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(input.data()), input.size(),
+         sha);
+    unsigned char accept[32];
+    const int len = EVP_EncodeBlock(accept, sha, SHA_DIGEST_LENGTH);
+    return std::string(reinterpret_cast<const char*>(accept), len);
+}
+
+// value of a header in an HTTP request/response (name is matched ignoring
+// case), empty if it isn't there
+inline std::string_view find_header(std::string_view message,
+                                    std::string_view name) {
+    std::size_t line = message.find("\r\n");
+    while ((line != std::string_view::npos) && (line + 2 < message.size())) {
+        line += 2;
+        const std::size_t end = message.find("\r\n", line);
+        const std::string_view header = message.substr(line, end - line);
+        const std::size_t colon = header.find(':');
+        if ((colon == name.size()) &&
+            std::equal(name.begin(), name.end(), header.begin(),
+                       [](char a, char b) {
+                           return std::tolower((unsigned char)a) ==
+                                  std::tolower((unsigned char)b);
+                       })) {
+            std::string_view value = header.substr(colon + 1);
+            while ((!value.empty()) && (value.front() == ' '))
+                value.remove_prefix(1);
+            while ((!value.empty()) && (value.back() == ' '))
+                value.remove_suffix(1);
+            return value;
+        }
+        line = end;
+    }
+    return {};
+}
+
+inline std::string
+build_websocket_handshake_response(std::string_view accept_key,
+                                   const std::string& extra_headers = "") {
+    std::string response;
+    response += "HTTP/1.1 101 Switching Protocols\r\n";
+    response += "Upgrade: websocket\r\n";
+    response += "Connection: Upgrade\r\n";
+    response += "Sec-WebSocket-Accept: ";
+    response += accept_key;
+    response += "\r\n";
+    response += extra_headers;
+    response += "\r\n";
+    return response;
+}
+
 } // namespace fastws
 
 #endif // _FASTWS_HANDSHAKE_HPP_
\ No newline at end of file
@@ -0,0 +1,327 @@
+#ifndef _FASTWS_IDLE_STRATEGY_HPP_
+#define _FASTWS_IDLE_STRATEGY_HPP_
+
+#include "clock.hpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace fastws {
+
+// tells the cpu we are spinning (pause on x86), saves power and frees the
+// core up for a hyperthread sibling
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+enum class IdlePhase { WORK = 0, SPIN, PAUSE, YIELD, BLOCK };
+
+inline const char* idle_phase_to_string(IdlePhase phase) {
+    switch (phase) {
+    case IdlePhase::WORK:
+        return "work";
+    case IdlePhase::SPIN:
+        return "spin";
+    case IdlePhase::PAUSE:
+        return "pause";
+    case IdlePhase::YIELD:
+        return "yield";
+    case IdlePhase::BLOCK:
+        return "block";
+    }
+    return "unknown";
+}
+
+// Time the poll loop spent in each phase. The time between two calls to
+// idle() is put down to whatever the first call decided to do (WORK if the
+// loop did something).
+struct IdleCounters {
+    static constexpr std::size_t phases = 5;
+    std::array<std::uint64_t, phases> ns = {};
+    std::array<std::uint64_t, phases> count = {};
+    // times the adaptive strategy changed its mind
+    std::uint64_t switches = 0;
+
+    std::uint64_t ns_in(IdlePhase phase) const {
+        return ns[static_cast<std::size_t>(phase)];
+    }
+
+    std::uint64_t count_in(IdlePhase phase) const {
+        return count[static_cast<std::size_t>(phase)];
+    }
+
+    void reset() { *this = IdleCounters(); }
+};
+
+// How to back off when polls come back empty: spin for a while, then
+// pause, then yield the core, then block until a socket is readable. Each
+// limit is the number of empty polls spent in that phase before moving on.
+struct IdleConfig {
+    static constexpr std::uint64_t forever =
+        std::numeric_limits<std::uint64_t>::max();
+
+    std::uint64_t spins = 0;
+    std::uint64_t pauses = 0;
+    std::uint64_t yields = 0;
+    // block on epoll for at most this long, so timers still get serviced
+    int block_timeout_ms = 1;
+
+    static IdleConfig busy_spin() { return {forever, 0, 0}; }
+
+    static IdleConfig spin_pause(std::uint64_t spins = 100) {
+        return {spins, forever, 0};
+    }
+
+    static IdleConfig spin_yield(std::uint64_t spins = 100,
+                                 std::uint64_t pauses = 1000) {
+        return {spins, pauses, forever};
+    }
+
+    static IdleConfig spin_block(std::uint64_t spins = 100,
+                                 std::uint64_t pauses = 1000,
+                                 std::uint64_t yields = 100,
+                                 int block_timeout_ms = 1) {
+        return {spins, pauses, yields, block_timeout_ms};
+    }
+};
+
+// Idle strategy for a poll loop. Call idle(work) once per iteration with
+// how much the iteration did (e.g. frames handled); it returns straight
+// away while there is work and backs off as described by the config while
+// there isn't. To block, the sockets of the clients being polled have to be
+// added with add(client.fd()). Another thread can cut a block short with
+// wake().
+class IdleStrategy {
+  private:
+    IdleConfig m_config;
+    IdleCounters m_counters;
+    std::uint64_t m_idle = 0; // empty polls in a row
+    IdlePhase m_phase = IdlePhase::WORK;
+    std::uint64_t m_last = 0; // fastws::clock ticks
+    int m_epoll = -1;
+    int m_event = -1;
+
+    void account(std::uint64_t now) {
+        const auto phase = static_cast<std::size_t>(m_phase);
+        m_counters.ns[phase] += clock::to_ns(now - m_last);
+        m_counters.count[phase]++;
+        m_last = now;
+    }
+
+    IdlePhase next_phase() const {
+        std::uint64_t limit = m_config.spins;
+        if (m_idle <= limit)
+            return IdlePhase::SPIN;
+        if (m_config.pauses > IdleConfig::forever - limit)
+            return IdlePhase::PAUSE;
+        limit += m_config.pauses;
+        if (m_idle <= limit)
+            return IdlePhase::PAUSE;
+        if (m_config.yields > IdleConfig::forever - limit)
+            return IdlePhase::YIELD;
+        limit += m_config.yields;
+        if (m_idle <= limit)
+            return IdlePhase::YIELD;
+        return IdlePhase::BLOCK;
+    }
+
+    void block() {
+#ifdef __linux__
+        epoll_event events[16];
+        const int n =
+            epoll_wait(m_epoll, events, 16, m_config.block_timeout_ms);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == m_event) {
+                std::uint64_t value;
+                (void)!::read(m_event, &value, sizeof(value));
+            }
+        }
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+  public:
+    IdleStrategy(const IdleConfig& config = IdleConfig::spin_block())
+        : m_config(config), m_last(clock::ticks()) {
+#ifdef __linux__
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ((m_epoll < 0) || (m_event < 0))
+            throw std::runtime_error("Failed to create epoll/eventfd");
+        add(m_event);
+#endif
+    }
+
+    IdleStrategy(const IdleStrategy&) = delete;
+    IdleStrategy& operator=(const IdleStrategy&) = delete;
+
+    ~IdleStrategy() {
+        if (m_event >= 0)
+            ::close(m_event);
+        if (m_epoll >= 0)
+            ::close(m_epoll);
+    }
+
+    // a socket whose readability ends a block
+    void add(int fd) {
+#ifdef __linux__
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+            throw std::runtime_error("Failed to add fd to epoll");
+#else
+        (void)fd;
+#endif
+    }
+
+    void remove(int fd) {
+#ifdef __linux__
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+#else
+        (void)fd;
+#endif
+    }
+
+    // ends a block early, safe to call from any thread
+    void wake() {
+#ifdef __linux__
+        const std::uint64_t one = 1;
+        (void)!::write(m_event, &one, sizeof(one));
+#endif
+    }
+
+    void idle(std::uint64_t work) {
+        account(clock::ticks());
+        if (work > 0) {
+            m_idle = 0;
+            m_phase = IdlePhase::WORK;
+            return;
+        }
+        m_idle++;
+        m_phase = next_phase();
+        switch (m_phase) {
+        case IdlePhase::PAUSE:
+            cpu_relax();
+            break;
+        case IdlePhase::YIELD:
+            std::this_thread::yield();
+            break;
+        case IdlePhase::BLOCK:
+            block();
+            break;
+        default:
+            break;
+        }
+    }
+
+    // start backing off from the beginning again
+    void reset() { m_idle = 0; }
+
+    void set_config(const IdleConfig& config) { m_config = config; }
+
+    const IdleConfig& config() const { return m_config; }
+
+    IdlePhase phase() const { return m_phase; }
+
+    const IdleCounters& counters() const { return m_counters; }
+    IdleCounters& counters() { return m_counters; }
+};
+
+// Picks the backoff from the recent message rate: feeds doing at least
+// hot_rate messages a second busy spin, ones doing at least warm_rate spin
+// and then yield, and anything quieter is allowed to block and give the
+// core back. The rate is measured over windows of window_ms.
+struct AdaptiveIdleConfig {
+    double hot_rate = 1000;
+    double warm_rate = 10;
+    int window_ms = 100;
+    IdleConfig hot = IdleConfig::busy_spin();
+    IdleConfig warm = IdleConfig::spin_yield();
+    IdleConfig quiet = IdleConfig::spin_block();
+};
+
+class AdaptiveIdleStrategy {
+  private:
+    AdaptiveIdleConfig m_config;
+    IdleStrategy m_strategy;
+    std::uint64_t m_window_start; // ns
+    std::uint64_t m_window_work = 0;
+    // messages a second over the last window
+    double m_rate = 0;
+    const IdleConfig* m_current;
+
+    void update_rate() {
+        const std::uint64_t now = clock::now_ns();
+        const std::uint64_t elapsed = now - m_window_start;
+        if (elapsed < std::uint64_t(m_config.window_ms) * 1000000)
+            return;
+        m_rate = ((double)m_window_work) * 1e9 / ((double)elapsed);
+        m_window_start = now;
+        m_window_work = 0;
+
+        const IdleConfig* config = &m_config.quiet;
+        if (m_rate >= m_config.hot_rate) {
+            config = &m_config.hot;
+        } else if (m_rate >= m_config.warm_rate) {
+            config = &m_config.warm;
+        }
+        if (config != m_current) {
+            m_current = config;
+            m_strategy.set_config(*config);
+            m_strategy.counters().switches++;
+        }
+    }
+
+  public:
+    AdaptiveIdleStrategy(const AdaptiveIdleConfig& config = {})
+        : m_config(config), m_strategy(m_config.quiet),
+          m_window_start(clock::now_ns()), m_current(&m_config.quiet) {}
+
+    void add(int fd) { m_strategy.add(fd); }
+
+    void remove(int fd) { m_strategy.remove(fd); }
+
+    void wake() { m_strategy.wake(); }
+
+    void idle(std::uint64_t work) {
+        m_window_work += work;
+        // only look at the clock once the loop runs out of work, so hot
+        // feeds don't pay for it on every message
+        if (work == 0)
+            update_rate();
+        m_strategy.idle(work);
+    }
+
+    double rate() const { return m_rate; }
+
+    const IdleConfig& config() const { return *m_current; }
+
+    IdlePhase phase() const { return m_strategy.phase(); }
+
+    const IdleCounters& counters() const { return m_strategy.counters(); }
+    IdleCounters& counters() { return m_strategy.counters(); }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_IDLE_STRATEGY_HPP_
@@ -0,0 +1,175 @@
+#ifndef _FASTWS_LOW_LATENCY_HPP_
+#define _FASTWS_LOW_LATENCY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fastws {
+
+// raises the calling thread to the max priority of its current scheduling
+// policy
+inline void set_max_priority() {
+    pthread_t thread = pthread_self();
+    int policy;
+    sched_param param = {};
+    pthread_getschedparam(thread, &policy, &param);
+    int max_priority = sched_get_priority_max(policy);
+    if (param.sched_priority != max_priority) {
+        param.sched_priority = max_priority;
+        if (pthread_setschedparam(thread, policy, &param) != 0) {
+            throw std::runtime_error("Failed to set thread policy");
+        }
+    }
+}
+
+// moves the calling thread to SCHED_FIFO (max priority if priority < 0),
+// needs CAP_SYS_NICE or a suitable RLIMIT_RTPRIO
+inline void set_realtime_priority(int priority = -1) {
+    sched_param param = {};
+    param.sched_priority =
+        priority < 0 ? sched_get_priority_max(SCHED_FIFO) : priority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        throw std::runtime_error("Failed to set SCHED_FIFO");
+    }
+}
+
+// pins the calling thread to a single cpu
+inline void pin_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        throw std::runtime_error("Failed to pin thread to cpu " +
+                                 std::to_string(cpu));
+    }
+#else
+    (void)cpu;
+    throw std::runtime_error("Thread pinning is not supported");
+#endif
+}
+
+// locks all current (and, if future, all later) pages in memory so they
+// never page fault after being touched once
+inline void lock_memory(bool future = true) {
+    if (mlockall(MCL_CURRENT | (future ? MCL_FUTURE : 0)) != 0) {
+        throw std::runtime_error("mlockall failed");
+    }
+}
+
+// touches every page in [ptr, ptr + size) so the first real write doesn't
+// fault
+inline void prefault(void* ptr, std::size_t size) {
+    const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    volatile std::uint8_t* buf = static_cast<std::uint8_t*>(ptr);
+    for (std::size_t i = 0; i < size; i += page) {
+        buf[i] = 0;
+    }
+}
+
+// Fixed chunk of memory, backed by 2 MB huge pages where the kernel lets us
+// (MAP_HUGETLB, else transparent huge pages through madvise), and prefaulted
+// up front. Hands out memory with a bump pointer and never gives any back,
+// so it is meant to back a BufferPool, not to be used directly.
+class HugePageArena {
+  private:
+    static constexpr std::size_t huge_page_size = 2 << 20;
+
+    std::uint8_t* m_buf = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_ptr = 0;
+    bool m_huge_pages = false;
+
+  public:
+    HugePageArena(std::size_t size) {
+        m_size = ((size + huge_page_size - 1) / huge_page_size) *
+                 huge_page_size;
+        void* buf = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        buf = mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        m_huge_pages = buf != MAP_FAILED;
+#endif
+        if (buf == MAP_FAILED) {
+            buf = mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (buf == MAP_FAILED)
+                throw std::runtime_error("Failed to map arena");
+#ifdef MADV_HUGEPAGE
+            madvise(buf, m_size, MADV_HUGEPAGE);
+#endif
+        }
+        m_buf = static_cast<std::uint8_t*>(buf);
+        prefault(m_buf, m_size);
+    }
+
+    HugePageArena(const HugePageArena&) = delete;
+    HugePageArena& operator=(const HugePageArena&) = delete;
+
+    ~HugePageArena() {
+        if (m_buf)
+            munmap(m_buf, m_size);
+    }
+
+    // returns nullptr once the arena is used up
+    std::uint8_t* allocate(std::size_t size, std::size_t align = 64) {
+        const std::size_t start = (m_ptr + align - 1) & ~(align - 1);
+        if (start + size > m_size)
+            return nullptr;
+        m_ptr = start + size;
+        return m_buf + start;
+    }
+
+    bool owns(const std::uint8_t* ptr) const {
+        return (ptr >= m_buf) && (ptr < m_buf + m_size);
+    }
+
+    // keep the arena resident, independent of lock_memory()
+    void lock() {
+        if (mlock(m_buf, m_size) != 0)
+            throw std::runtime_error("mlock failed");
+    }
+
+    // whether we actually got MAP_HUGETLB pages
+    bool huge_pages() const { return m_huge_pages; }
+
+    std::size_t size() const { return m_size; }
+
+    std::size_t used() const { return m_ptr; }
+};
+
+// everything a latency sensitive polling thread wants set up front
+struct LowLatencyProfile {
+    // bytes of huge page memory backing the buffer pool
+    std::size_t arena_size = 16 << 20;
+    // buffer sizes to reserve for each client
+    std::size_t receive_buffer = 1 << 20;
+    std::size_t send_buffer = 64 << 10;
+    // mlockall(MCL_CURRENT | MCL_FUTURE)
+    bool lock_memory = false;
+    // pin the polling thread to this cpu (if >= 0)
+    int cpu = -1;
+    // run the polling thread as SCHED_FIFO
+    bool realtime = false;
+};
+
+// applies the thread side of a profile to the calling thread
+inline void apply_to_thread(const LowLatencyProfile& profile) {
+    if (profile.cpu >= 0)
+        pin_thread(profile.cpu);
+    if (profile.realtime)
+        set_realtime_priority();
+    if (profile.lock_memory)
+        lock_memory();
+}
+
+} // namespace fastws
+
+#endif // _FASTWS_LOW_LATENCY_HPP_
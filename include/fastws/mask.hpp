@@ -0,0 +1,112 @@
+#ifndef _FASTWS_MASK_HPP_
+#define _FASTWS_MASK_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define FASTWS_MASK_X86 1
+#include <immintrin.h>
+#endif
+
+namespace fastws {
+
+namespace detail {
+
+// the key as it lines up with a payload that starts offset bytes into the
+// frame, so the loops below can always start at key byte 0
+inline std::uint32_t rotated_key(const std::uint8_t* masking_key,
+                                 std::size_t offset) {
+    std::uint8_t key[4];
+    for (int i = 0; i < 4; i++) {
+        key[i] = masking_key[(offset + i) % 4];
+    }
+    std::uint32_t key32;
+    std::memcpy(&key32, key, 4);
+    return key32;
+}
+
+// 8 bytes at a time, returns how many bytes it did
+inline std::size_t mask_swar(std::uint8_t* out, const std::uint8_t* payload,
+                             std::size_t len, std::uint32_t key32) {
+    const std::uint64_t key64 = (std::uint64_t(key32) << 32) | key32;
+    std::size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, payload + i, 8);
+        word ^= key64;
+        std::memcpy(out + i, &word, 8);
+    }
+    return i;
+}
+
+#ifdef FASTWS_MASK_X86
+
+__attribute__((target("sse2"))) inline std::size_t
+mask_sse2(std::uint8_t* out, const std::uint8_t* payload, std::size_t len,
+          std::uint32_t key32) {
+    const __m128i key = _mm_set1_epi32((int)key32);
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i data =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(payload + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                         _mm_xor_si128(data, key));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) inline std::size_t
+mask_avx2(std::uint8_t* out, const std::uint8_t* payload, std::size_t len,
+          std::uint32_t key32) {
+    const __m256i key = _mm256_set1_epi32((int)key32);
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i data =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(payload + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                            _mm256_xor_si256(data, key));
+    }
+    return i;
+}
+
+inline bool has_avx2() {
+    static const bool avx2 = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }();
+    return avx2;
+}
+
+#endif // FASTWS_MASK_X86
+
+} // namespace detail
+
+// Xors payload with the 4 byte masking key into out, which can be the same
+// as payload to (un)mask in place. offset is where payload starts within the
+// frame's payload, for frames that are handled in pieces. 32 bytes at a time
+// with AVX2, 16 with SSE2, 8 otherwise.
+inline void mask_payload(std::uint8_t* out, const std::uint8_t* payload,
+                         std::size_t len, const std::uint8_t* masking_key,
+                         std::size_t offset = 0) {
+    const std::uint32_t key32 = detail::rotated_key(masking_key, offset);
+    std::size_t i = 0;
+#ifdef FASTWS_MASK_X86
+    if (len >= 32 && detail::has_avx2()) {
+        i = detail::mask_avx2(out, payload, len, key32);
+    } else if (len >= 16) {
+        i = detail::mask_sse2(out, payload, len, key32);
+    }
+#endif
+    // every loop does a multiple of 4 bytes, so the key still lines up
+    i += detail::mask_swar(out + i, payload + i, len - i, key32);
+    for (; i < len; i++) {
+        out[i] = payload[i] ^ masking_key[(offset + i) % 4];
+    }
+}
+
+} // namespace fastws
+
+#endif // _FASTWS_MASK_HPP_
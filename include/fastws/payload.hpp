@@ -0,0 +1,331 @@
+#ifndef _FASTWS_PAYLOAD_HPP_
+#define _FASTWS_PAYLOAD_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fastws {
+
+class SlabPool;
+
+namespace detail {
+
+// the start of every slab, the data follows
+struct SlabHeader {
+    std::atomic<std::uint32_t> refs;
+    std::size_t capacity;
+    SlabPool* pool;
+
+    std::uint8_t* data() { return reinterpret_cast<std::uint8_t*>(this + 1); }
+};
+
+} // namespace detail
+
+// Thread safe cache of reference counted slabs for receive buffers whose
+// payloads can be kept after the handler returns (see SlabBuffer). Slabs
+// are slab_size bytes, or bigger for frames that don't fit, and go back to
+// the pool when the buffer and every Payload pointing into them are done
+// with them, from whichever thread that happens on. Bigger slabs, and any
+// past max_cached_bytes, are freed instead. The pool has to outlive every
+// slab it handed out.
+class SlabPool {
+  private:
+    std::size_t m_slab_size;
+    std::size_t m_max_cached_bytes;
+    std::mutex m_mutex;
+    std::vector<detail::SlabHeader*> m_free;
+
+  public:
+    SlabPool(std::size_t slab_size = 256 << 10,
+             std::size_t max_cached_bytes = 64 << 20)
+        : m_slab_size(slab_size), m_max_cached_bytes(max_cached_bytes) {}
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    ~SlabPool() {
+        for (auto* slab : m_free) {
+            std::free(slab);
+        }
+    }
+
+    // shared by clients that weren't given a pool of their own
+    static SlabPool& global() {
+        static SlabPool pool;
+        return pool;
+    }
+
+    std::size_t slab_size() const { return m_slab_size; }
+
+    // a slab of at least min_size bytes, with one reference
+    detail::SlabHeader* acquire(std::size_t min_size) {
+        detail::SlabHeader* slab = nullptr;
+        if (min_size <= m_slab_size) {
+            min_size = m_slab_size;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_free.empty()) {
+                slab = m_free.back();
+                m_free.pop_back();
+            }
+        }
+        if (!slab) {
+            void* mem = std::malloc(sizeof(detail::SlabHeader) + min_size);
+            if (!mem)
+                throw std::bad_alloc();
+            slab = new (mem) detail::SlabHeader;
+            slab->capacity = min_size;
+            slab->pool = this;
+        }
+        slab->refs.store(1, std::memory_order_relaxed);
+        return slab;
+    }
+
+    // called once the last reference is gone
+    void release(detail::SlabHeader* slab) {
+        if (slab->capacity == m_slab_size) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if ((m_free.size() + 1) * m_slab_size <= m_max_cached_bytes) {
+                m_free.push_back(slab);
+                return;
+            }
+        }
+        std::free(slab);
+    }
+
+    // bytes sitting in the pool waiting to be reused
+    std::size_t bytes_cached() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_free.size() * m_slab_size;
+    }
+};
+
+namespace detail {
+
+inline void add_ref(SlabHeader* slab) {
+    slab->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void drop_ref(SlabHeader* slab) {
+    if (slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        slab->pool->release(slab);
+}
+
+} // namespace detail
+
+// A payload that stays valid for as long as there is a handle to it. Copies
+// share the bytes (copying is an atomic increment), and the slab they live
+// in is recycled once the last handle is gone. Handles can be passed to and
+// dropped on other threads, the bytes are read only.
+class Payload {
+  private:
+    detail::SlabHeader* m_slab = nullptr;
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+
+  public:
+    Payload() = default;
+
+    Payload(detail::SlabHeader* slab, const char* data, std::size_t size)
+        : m_slab(slab), m_data(data), m_size(size) {}
+
+    Payload(const Payload& other)
+        : m_slab(other.m_slab), m_data(other.m_data), m_size(other.m_size) {
+        if (m_slab)
+            detail::add_ref(m_slab);
+    }
+
+    Payload(Payload&& other)
+        : m_slab(std::exchange(other.m_slab, nullptr)),
+          m_data(std::exchange(other.m_data, nullptr)),
+          m_size(std::exchange(other.m_size, 0)) {}
+
+    Payload& operator=(Payload other) {
+        std::swap(m_slab, other.m_slab);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        return *this;
+    }
+
+    ~Payload() {
+        if (m_slab)
+            detail::drop_ref(m_slab);
+    }
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    std::string_view view() const { return std::string_view(m_data, m_size); }
+    operator std::string_view() const { return view(); }
+};
+
+// Receive buffer (with the PooledBuffer interface) on reference counted
+// slabs from a SlabPool, which lets retain() hand out Payloads for bytes in
+// it. Bytes are never moved or overwritten while a Payload points into the
+// slab: compacting or growing a shared slab moves what is left over to a
+// fresh one instead, and the old one lives on with its Payloads.
+class SlabBuffer {
+  private:
+    SlabPool* m_pool = &SlabPool::global();
+    detail::SlabHeader* m_slab = nullptr;
+    std::size_t m_ptr = 0;
+
+    bool shared() const {
+        return m_slab && (m_slab->refs.load(std::memory_order_acquire) > 1);
+    }
+
+    // moves the bytes from offset on to a slab of at least sz bytes
+    void move_to_new_slab(std::size_t sz, std::size_t offset = 0) {
+        detail::SlabHeader* slab = m_pool->acquire(sz);
+        const std::size_t keep = m_ptr - offset;
+        if (keep > 0)
+            std::memcpy(slab->data(), m_slab->data() + offset, keep);
+        if (m_slab)
+            detail::drop_ref(m_slab);
+        m_slab = slab;
+        m_ptr = keep;
+    }
+
+  public:
+    SlabBuffer(SlabPool* pool = nullptr) {
+        if (pool)
+            m_pool = pool;
+    }
+
+    SlabBuffer(const SlabBuffer&) = delete;
+    SlabBuffer& operator=(const SlabBuffer&) = delete;
+
+    SlabBuffer(SlabBuffer&& other)
+        : m_pool(other.m_pool), m_slab(std::exchange(other.m_slab, nullptr)),
+          m_ptr(std::exchange(other.m_ptr, 0)) {}
+
+    SlabBuffer& operator=(SlabBuffer&& other) {
+        if (this != &other) {
+            if (m_slab)
+                detail::drop_ref(m_slab);
+            m_pool = other.m_pool;
+            m_slab = std::exchange(other.m_slab, nullptr);
+            m_ptr = std::exchange(other.m_ptr, 0);
+        }
+        return *this;
+    }
+
+    ~SlabBuffer() {
+        if (m_slab)
+            detail::drop_ref(m_slab);
+    }
+
+    // takes slabs from pool from now on
+    void set_pool(SlabPool* pool) {
+        if (!shared() && (m_ptr == 0))
+            release();
+        m_pool = pool ? pool : &SlabPool::global();
+    }
+
+    SlabPool* pool() const { return m_pool; }
+
+    // lets go of the slab, only if the buffer is empty
+    bool release() {
+        if ((m_ptr != 0) || !m_slab)
+            return false;
+        detail::drop_ref(std::exchange(m_slab, nullptr));
+        return true;
+    }
+
+    std::size_t capacity() const { return m_slab ? m_slab->capacity : 0; }
+
+    void reset() {
+        // anything still pointing into the slab keeps it, we start again
+        if (shared()) {
+            detail::drop_ref(m_slab);
+            m_slab = nullptr;
+        }
+        m_ptr = 0;
+    }
+
+    void ensure_fit(std::size_t sz) {
+        if (capacity() < sz)
+            move_to_new_slab(std::max(sz, capacity() * 2));
+    }
+
+    void ensure_extra_space(std::size_t extra) { ensure_fit(m_ptr + extra); }
+
+    // drops the first n bytes, moving the rest to the front
+    void discard_front(std::size_t n) {
+        if (n == 0)
+            return;
+        if (shared() && (m_ptr > n)) {
+            move_to_new_slab(m_ptr - n, n);
+            return;
+        }
+        if (shared()) {
+            reset();
+            return;
+        }
+        if (m_ptr > n)
+            std::memmove(m_slab->data(), m_slab->data() + n, m_ptr - n);
+        m_ptr -= n;
+    }
+
+    // A Payload for bytes in the buffer. Anything else (a view that doesn't
+    // point into the buffer) is copied into a slab of its own.
+    Payload retain(std::string_view bytes) {
+        const auto* start = reinterpret_cast<const std::uint8_t*>(bytes.data());
+        if (m_slab && (start >= head()) && (start + bytes.size() <= tail())) {
+            detail::add_ref(m_slab);
+            return Payload(m_slab, bytes.data(), bytes.size());
+        }
+        detail::SlabHeader* slab = m_pool->acquire(bytes.size());
+        if (!bytes.empty())
+            std::memcpy(slab->data(), bytes.data(), bytes.size());
+        return Payload(slab, reinterpret_cast<const char*>(slab->data()),
+                       bytes.size());
+    }
+
+    // no bounds checking
+    void push_back(std::uint8_t byte) {
+        m_slab->data()[m_ptr] = byte;
+        m_ptr++;
+    }
+
+    // no bounds checking
+    std::uint8_t* get_space(std::size_t sz) {
+        std::uint8_t* out = tail();
+        m_ptr += sz;
+        return out;
+    }
+
+    void claim_space(std::size_t sz) { m_ptr += sz; }
+
+    void push_back(std::string_view view) {
+        ensure_extra_space(view.size());
+        std::memcpy(get_space(view.size()), view.data(), view.size());
+    }
+
+    std::uint8_t* head() { return m_slab ? m_slab->data() : nullptr; }
+    const std::uint8_t* head() const {
+        return m_slab ? m_slab->data() : nullptr;
+    }
+
+    std::uint8_t* tail() { return head() + m_ptr; }
+    const std::uint8_t* tail() const { return head() + m_ptr; }
+
+    std::size_t size() const { return m_ptr; }
+
+    std::string_view view() const {
+        return std::string_view((const char*)head(), m_ptr);
+    }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_PAYLOAD_HPP_
@@ -0,0 +1,378 @@
+#ifndef _FASTWS_RESOLVER_HPP_
+#define _FASTWS_RESOLVER_HPP_
+
+#include "clock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+namespace fastws {
+
+class ResolverException : public std::runtime_error {
+  public:
+    explicit ResolverException(const std::string& msg)
+        : std::runtime_error(msg) {}
+};
+
+// one address to connect() to, IPv4 or IPv6
+struct ResolvedAddress {
+    sockaddr_storage addr = {};
+    socklen_t len = 0;
+
+    int family() const { return addr.ss_family; }
+
+    const sockaddr* get() const {
+        return reinterpret_cast<const sockaddr*>(&addr);
+    }
+
+    // numeric form, e.g. 127.0.0.1 or ::1
+    std::string to_string() const {
+        char out[INET6_ADDRSTRLEN] = {};
+        const void* src =
+            family() == AF_INET6
+                ? (const void*)&reinterpret_cast<const sockaddr_in6*>(&addr)
+                      ->sin6_addr
+                : (const void*)&reinterpret_cast<const sockaddr_in*>(&addr)
+                      ->sin_addr;
+        inet_ntop(family(), src, out, sizeof(out));
+        return out;
+    }
+
+    bool operator==(const ResolvedAddress& other) const {
+        return (len == other.len) &&
+               (std::memcmp(&addr, &other.addr, len) == 0);
+    }
+
+    // builds an address from a numeric IPv4/IPv6 string, throws if it isn't
+    // one
+    static ResolvedAddress from_numeric(const std::string& ip, long port) {
+        ResolvedAddress out;
+        auto* v4 = reinterpret_cast<sockaddr_in*>(&out.addr);
+        auto* v6 = reinterpret_cast<sockaddr_in6*>(&out.addr);
+        if (inet_pton(AF_INET, ip.c_str(), &v4->sin_addr) == 1) {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(static_cast<std::uint16_t>(port));
+            out.len = sizeof(sockaddr_in);
+        } else if (inet_pton(AF_INET6, ip.c_str(), &v6->sin6_addr) == 1) {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(static_cast<std::uint16_t>(port));
+            out.len = sizeof(sockaddr_in6);
+        } else {
+            throw ResolverException("Not a numeric address: " + ip);
+        }
+        return out;
+    }
+};
+
+// in the order they should be tried
+using AddressList = std::vector<ResolvedAddress>;
+
+// the address that won a TCP connect race to a host (see
+// detail::race_connect), and how long its TCP connect took
+struct PreferredAddress {
+    ResolvedAddress addr;
+    std::uint64_t connect_ns = 0;
+};
+
+// how host names are turned into addresses, swappable for tests
+using LookupFunction =
+    std::function<AddressList(const std::string& host, long port)>;
+
+// blocking getaddrinfo lookup of both IPv4 and IPv6 addresses
+inline AddressList getaddrinfo_lookup(const std::string& host, long port) {
+    struct addrinfo hints = {}, *addrs = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(),
+                             &hints, &addrs);
+        rc != 0) {
+        throw ResolverException(std::string(gai_strerror(rc)));
+    }
+
+    AddressList out;
+    for (addrinfo* addr = addrs; addr != NULL; addr = addr->ai_next) {
+        ResolvedAddress resolved;
+        std::memcpy(&resolved.addr, addr->ai_addr, addr->ai_addrlen);
+        resolved.len = addr->ai_addrlen;
+        out.push_back(resolved);
+    }
+    freeaddrinfo(addrs);
+    return out;
+}
+
+// Resolves host names on a background thread and caches the results for
+// ttl, so connecting (and reconnecting) doesn't wait on DNS once an address
+// is known. Entries that have expired are still handed out while a refresh
+// runs in the background. Lookups that fail are cached for failure_ttl so a
+// dead resolver isn't hammered. The sockets also record which address won a
+// TCP connect race here, so it is tried first from then on.
+class Resolver {
+  public:
+    using AddressListPtr = std::shared_ptr<const AddressList>;
+
+  private:
+    struct Entry {
+        AddressListPtr addrs;
+        std::string error;
+        std::uint64_t expires = 0; // ns, on fastws::clock
+        bool pending = false;
+        std::optional<PreferredAddress> preferred;
+    };
+
+    LookupFunction m_lookup;
+    std::uint64_t m_ttl;         // ns
+    std::uint64_t m_failure_ttl; // ns
+
+    std::mutex m_mutex;
+    std::condition_variable m_queue_cv;
+    std::condition_variable m_done_cv;
+    std::unordered_map<std::string, Entry> m_cache;
+    std::deque<std::pair<std::string, long>> m_queue;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    static std::string key(const std::string& host, long port) {
+        return host + ":" + std::to_string(port);
+    }
+
+    // m_mutex must be held
+    void enqueue(const std::string& host, long port, Entry& entry) {
+        if (entry.pending)
+            return;
+        entry.pending = true;
+        m_queue.emplace_back(host, port);
+        m_queue_cv.notify_one();
+    }
+
+    // moves the preferred address to the front, forgetting the preference
+    // if it isn't in the list anymore
+    static void apply_preference(Entry& entry) {
+        if ((!entry.preferred) || (!entry.addrs))
+            return;
+        auto it = std::find(entry.addrs->begin(), entry.addrs->end(),
+                            entry.preferred->addr);
+        if (it == entry.addrs->end()) {
+            entry.preferred.reset();
+            return;
+        }
+        const std::size_t idx = it - entry.addrs->begin();
+        if (idx == 0)
+            return;
+        AddressList addrs = *entry.addrs;
+        std::rotate(addrs.begin(), addrs.begin() + idx,
+                    addrs.begin() + idx + 1);
+        entry.addrs = std::make_shared<const AddressList>(std::move(addrs));
+    }
+
+    // m_mutex must be held
+    void refresh_if_stale(const std::string& host, long port, Entry& entry) {
+        if ((!entry.addrs && entry.error.empty()) ||
+            (clock::now_ns() >= entry.expires))
+            enqueue(host, port, entry);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_queue_cv.wait(lock,
+                            [this] { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+                return;
+            auto [host, port] = std::move(m_queue.front());
+            m_queue.pop_front();
+
+            lock.unlock();
+            AddressListPtr addrs;
+            std::string error;
+            try {
+                addrs =
+                    std::make_shared<const AddressList>(m_lookup(host, port));
+                if (addrs->empty())
+                    error = "No addresses for " + host;
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            lock.lock();
+
+            Entry& entry = m_cache[key(host, port)];
+            entry.pending = false;
+            if (error.empty()) {
+                entry.addrs = std::move(addrs);
+                entry.error.clear();
+                entry.expires = clock::now_ns() + m_ttl;
+                apply_preference(entry);
+            } else {
+                // keep serving a stale result over an error
+                if (!entry.addrs)
+                    entry.error = std::move(error);
+                entry.expires = clock::now_ns() + m_failure_ttl;
+            }
+            m_done_cv.notify_all();
+        }
+    }
+
+  public:
+    Resolver(std::chrono::milliseconds ttl = std::chrono::seconds(60),
+             LookupFunction lookup = getaddrinfo_lookup,
+             std::chrono::milliseconds failure_ttl = std::chrono::seconds(1))
+        : m_lookup(std::move(lookup)), m_ttl(ttl.count() * 1000000),
+          m_failure_ttl(failure_ttl.count() * 1000000),
+          m_thread([this] { run(); }) {}
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    ~Resolver() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_queue_cv.notify_one();
+        m_thread.join();
+    }
+
+    // shared by all sockets that aren't given a resolver
+    static Resolver& global() {
+        static Resolver resolver;
+        return resolver;
+    }
+
+    // IPv4/IPv6 literals, which never need a lookup
+    static bool is_numeric(const std::string& host) {
+        in6_addr addr;
+        return (inet_pton(AF_INET, host.c_str(), &addr) == 1) ||
+               (inet_pton(AF_INET6, host.c_str(), &addr) == 1);
+    }
+
+    static AddressListPtr numeric(const std::string& host, long port) {
+        return std::make_shared<const AddressList>(
+            AddressList{ResolvedAddress::from_numeric(host, port)});
+    }
+
+    // starts resolving host in the background if it isn't cached (or has
+    // expired), never blocks
+    void prefetch(const std::string& host, long port) {
+        if (is_numeric(host))
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        refresh_if_stale(host, port, m_cache[key(host, port)]);
+    }
+
+    // Cached addresses for host, or nullptr if we don't have any yet (in
+    // which case a lookup is started). Never blocks.
+    AddressListPtr try_get(const std::string& host, long port) {
+        if (is_numeric(host))
+            return numeric(host, port);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry& entry = m_cache[key(host, port)];
+        refresh_if_stale(host, port, entry);
+        return entry.addrs;
+    }
+
+    // Cached addresses for host, waiting up to timeout for the background
+    // thread if there aren't any yet. Throws if the lookup failed or timed
+    // out.
+    AddressListPtr resolve(const std::string& host, long port,
+                           std::chrono::milliseconds timeout =
+                               std::chrono::seconds(10)) {
+        if (is_numeric(host))
+            return numeric(host, port);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const std::string k = key(host, port);
+        Entry& entry = m_cache[k];
+        const std::uint64_t now = clock::now_ns();
+        if (entry.addrs) {
+            if (now >= entry.expires)
+                enqueue(host, port, entry);
+            return entry.addrs;
+        }
+        if (!entry.error.empty() && (now < entry.expires))
+            throw ResolverException(entry.error);
+        entry.error.clear();
+        enqueue(host, port, entry);
+        // look the entry up again after waiting, it might have been
+        // invalidated in the meantime
+        auto done = [this, &k] {
+            auto it = m_cache.find(k);
+            return (it == m_cache.end()) || !it->second.pending;
+        };
+        if (!m_done_cv.wait_for(lock, timeout, done))
+            throw ResolverException("Timed out resolving " + host);
+        auto it = m_cache.find(k);
+        if ((it == m_cache.end()) || !it->second.addrs)
+            throw ResolverException(
+                it == m_cache.end() ? "Lookup of " + host + " was invalidated"
+                                    : it->second.error);
+        return it->second.addrs;
+    }
+
+    // forget what we know about host, e.g. after failing to connect to it
+    void invalidate(const std::string& host, long port) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_cache.find(key(host, port));
+        if ((it == m_cache.end()) || it->second.pending)
+            return;
+        m_cache.erase(it);
+    }
+
+    // Puts addr first in host's addresses from now on (including after the
+    // entry is refreshed, as long as addr is still in it).
+    void prefer(const std::string& host, long port, const ResolvedAddress& addr,
+                std::uint64_t connect_ns = 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry& entry = m_cache[key(host, port)];
+        entry.preferred = PreferredAddress{addr, connect_ns};
+        apply_preference(entry);
+    }
+
+    std::optional<PreferredAddress> preferred(const std::string& host,
+                                              long port) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_cache.find(key(host, port));
+        if (it == m_cache.end())
+            return {};
+        return it->second.preferred;
+    }
+
+    // the next connect to host races TCP connects to its addresses again
+    void clear_preference(const std::string& host, long port) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_cache.find(key(host, port));
+        if (it != m_cache.end())
+            it->second.preferred.reset();
+    }
+
+    // whether there is an unexpired result for host
+    bool cached(const std::string& host, long port) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_cache.find(key(host, port));
+        return (it != m_cache.end()) && it->second.addrs &&
+               (clock::now_ns() < it->second.expires);
+    }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_RESOLVER_HPP_
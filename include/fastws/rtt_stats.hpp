@@ -0,0 +1,81 @@
+#ifndef _FASTWS_RTT_STATS_HPP_
+#define _FASTWS_RTT_STATS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+namespace fastws {
+
+// Rolling round trip statistics for one connection, in ns. Keeps an EWMA
+// (weighted like TCP's smoothed RTT), the min/max, RFC 3550 style jitter
+// (the smoothed difference between consecutive samples), and the last
+// `window` samples for percentiles. Recording is O(1); percentiles copy the
+// window, so they are for reporting rather than the hot path.
+class RttStats {
+  public:
+    static constexpr std::size_t window = 256;
+    static constexpr double ewma_weight = 1.0 / 8.0;
+    static constexpr double jitter_weight = 1.0 / 16.0;
+
+  private:
+    std::array<std::uint64_t, window> m_samples = {};
+    std::uint64_t m_count = 0;
+    std::uint64_t m_last = 0;
+    std::uint64_t m_min = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t m_max = 0;
+    double m_ewma = 0;
+    double m_jitter = 0;
+
+  public:
+    void record(std::uint64_t rtt_ns) {
+        if (m_count == 0) {
+            m_ewma = (double)rtt_ns;
+        } else {
+            m_ewma += ewma_weight * ((double)rtt_ns - m_ewma);
+            const double delta =
+                std::abs((double)rtt_ns - (double)m_last);
+            m_jitter += jitter_weight * (delta - m_jitter);
+        }
+        m_samples[m_count % window] = rtt_ns;
+        m_count++;
+        m_last = rtt_ns;
+        m_min = std::min(m_min, rtt_ns);
+        m_max = std::max(m_max, rtt_ns);
+    }
+
+    void reset() { *this = RttStats(); }
+
+    // samples recorded since the start (or reset)
+    std::uint64_t count() const { return m_count; }
+
+    // 0 until there is a sample
+    std::uint64_t last() const { return m_last; }
+    std::uint64_t min() const { return m_count ? m_min : 0; }
+    std::uint64_t max() const { return m_max; }
+    double ewma() const { return m_ewma; }
+    double jitter() const { return m_jitter; }
+
+    // p in [0, 1], over the last `window` samples
+    std::uint64_t percentile(double p) const {
+        const std::size_t n = std::min<std::uint64_t>(m_count, window);
+        if (n == 0)
+            return 0;
+        std::array<std::uint64_t, window> sorted;
+        std::copy_n(m_samples.begin(), n, sorted.begin());
+        const std::size_t rank = std::min<std::size_t>(
+            n - 1, (std::size_t)(std::clamp(p, 0.0, 1.0) * (double)n));
+        std::nth_element(sorted.begin(), sorted.begin() + rank,
+                         sorted.begin() + n);
+        return sorted[rank];
+    }
+
+    std::uint64_t p50() const { return percentile(0.5); }
+    std::uint64_t p99() const { return percentile(0.99); }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_RTT_STATS_HPP_
@@ -0,0 +1,528 @@
+#ifndef _FASTWS_SERVER_HPP_
+#define _FASTWS_SERVER_HPP_
+
+#include "buffer_pool.hpp"
+#include "frame_factory.hpp"
+#include "handshake.hpp"
+#include "resolver.hpp"
+#include "socket_options.hpp"
+#include "streaming_parser.hpp"
+#include "wsframe/wsframe.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace fastws {
+
+class ServerException : public std::runtime_error {
+  public:
+    explicit ServerException(const std::string& msg)
+        : std::runtime_error(msg) {}
+};
+
+// WebSocket server (plain TCP) for fanning data out to many clients from one
+// thread. An epoll loop accepts connections, does the upgrade and parses
+// client frames with the same parser as the client (unmasking them in
+// place). Frames go out unmasked, and broadcasts serialize a frame once and
+// write the same bytes to every connection. Writes that would block are
+// kept per connection and flushed when the socket is writable; a connection
+// that falls more than max_backlog bytes behind is dropped.
+//
+// The handler needs
+//   on_open(Server&, Server::Connection&)
+//   on_close(Server&, Server::Connection&)
+//   on_text/on_binary/on_continuation(Server&, Server::Connection&,
+//                                     wsframe::Frame)
+// where the frame's payload is only valid for the duration of the call.
+template <class Handler> class WSServer {
+  public:
+    class Connection {
+      private:
+        friend class WSServer;
+
+        enum class State { HANDSHAKE, OPEN, CLOSING, CLOSED };
+
+        WSServer* m_server;
+        int m_fd;
+        std::uint64_t m_id;
+        State m_state = State::HANDSHAKE;
+        std::string m_path;
+        std::string m_request;
+        StreamingFrameParser m_parser;
+        // what the socket wouldn't take yet, from m_backlog_sent on
+        std::string m_backlog;
+        std::size_t m_backlog_sent = 0;
+        bool m_want_write = false;
+        // index in the server's connections
+        std::size_t m_slot = 0;
+
+      public:
+        Connection(WSServer* server, int fd, std::uint64_t id)
+            : m_server(server), m_fd(fd), m_id(id) {}
+
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        // unique for the lifetime of the server
+        std::uint64_t id() const { return m_id; }
+
+        int fd() const { return m_fd; }
+
+        // the path from the upgrade request
+        const std::string& path() const { return m_path; }
+
+        bool open() const { return m_state == State::OPEN; }
+
+        // bytes waiting to be written
+        std::size_t backlog() const {
+            return m_backlog.size() - m_backlog_sent;
+        }
+
+        void send_text(std::string_view payload) {
+            send_frame(m_server->m_factory.text(true, false, payload));
+        }
+
+        void send_binary(std::string_view payload) {
+            send_frame(m_server->m_factory.binary(true, false, payload));
+        }
+
+        // an already serialized (unmasked) frame, as is
+        void send_frame(std::string_view frame) {
+            if (m_state == State::OPEN)
+                m_server->write(*this, frame);
+        }
+
+        // sends CLOSE, the connection goes once the client answers (or
+        // hangs up)
+        void close(std::uint16_t code = 1000) {
+            if (m_state != State::OPEN)
+                return;
+            const std::array<char, 2> payload = {
+                static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+            m_server->write(*this,
+                            m_server->m_factory.close(
+                                false, std::string_view(payload.data(), 2)));
+            if (m_state == State::OPEN)
+                m_state = State::CLOSING;
+        }
+    };
+
+    static constexpr std::size_t max_read_size = 1 << 16;
+    static constexpr std::size_t max_request_size = 8 << 10;
+
+  private:
+    Handler& m_handler;
+    int m_listen_fd = -1;
+    int m_epoll_fd = -1;
+    long m_port = 0;
+    SocketOptions m_socket_options;
+    std::array<epoll_event, 64> m_events;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+    std::vector<Connection*> m_dead;
+    std::uint64_t m_next_id = 0;
+    FrameFactory m_factory;
+    BufferPool* m_pool = nullptr;
+    std::size_t m_max_backlog = 16 << 20;
+    std::uint64_t m_max_message_size =
+        std::numeric_limits<std::uint64_t>::max();
+
+    void watch(Connection& conn, bool want_write) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN | (want_write ? std::uint32_t(EPOLLOUT) : 0u);
+        ev.data.ptr = &conn;
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, conn.m_fd, &ev);
+        conn.m_want_write = want_write;
+    }
+
+    // closes the socket straight away, the connection is freed at the end
+    // of poll() so pointers to it stay good until then
+    void drop(Connection& conn) {
+        if (conn.m_state == Connection::State::CLOSED)
+            return;
+        const bool was_open = conn.m_state != Connection::State::HANDSHAKE;
+        conn.m_state = Connection::State::CLOSED;
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, conn.m_fd, nullptr);
+        ::close(conn.m_fd);
+        // the fd can be reused by the next accept, so nothing may go out
+        // on it any more
+        conn.m_backlog.clear();
+        conn.m_backlog_sent = 0;
+        m_dead.push_back(&conn);
+        if (was_open)
+            m_handler.on_close(*this, conn);
+    }
+
+    void reap() {
+        for (Connection* conn : m_dead) {
+            const std::size_t slot = conn->m_slot;
+            std::swap(m_connections[slot], m_connections.back());
+            m_connections[slot]->m_slot = slot;
+            m_connections.pop_back();
+        }
+        m_dead.clear();
+    }
+
+    void write(Connection& conn, std::string_view data) {
+        if (conn.m_state == Connection::State::CLOSED)
+            return;
+        std::size_t sent = 0;
+        if (conn.backlog() == 0) {
+            const ssize_t n = ::send(conn.m_fd, data.data(), data.size(),
+                                     MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                    drop(conn);
+                    return;
+                }
+            } else {
+                sent = n;
+            }
+        }
+        if (sent == data.size())
+            return;
+        // a slow consumer isn't allowed to hold everyone else's memory
+        if (conn.backlog() + data.size() - sent > m_max_backlog) {
+            drop(conn);
+            return;
+        }
+        // don't hang on to what has gone out already
+        if (conn.m_backlog_sent > conn.m_backlog.size() / 2) {
+            conn.m_backlog.erase(0, conn.m_backlog_sent);
+            conn.m_backlog_sent = 0;
+        }
+        conn.m_backlog.append(data.substr(sent));
+        if (!conn.m_want_write)
+            watch(conn, true);
+    }
+
+    void flush(Connection& conn) {
+        if (conn.m_state == Connection::State::CLOSED)
+            return;
+        while (conn.backlog() > 0) {
+            const ssize_t n =
+                ::send(conn.m_fd, conn.m_backlog.data() + conn.m_backlog_sent,
+                       conn.backlog(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                    drop(conn);
+                return;
+            }
+            conn.m_backlog_sent += n;
+        }
+        conn.m_backlog.clear();
+        conn.m_backlog_sent = 0;
+        if (conn.m_want_write)
+            watch(conn, false);
+    }
+
+    void accept_all() {
+        for (;;) {
+            const int fd = ::accept4(m_listen_fd, nullptr, nullptr,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+            sockaddr_storage addr;
+            socklen_t len = sizeof(addr);
+            ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+            apply_socket_options(fd, addr.ss_family, m_socket_options);
+            auto conn = std::make_unique<Connection>(this, fd, m_next_id++);
+            if (m_pool)
+                conn->m_parser.frame_buffer().set_pool(m_pool);
+            conn->m_parser.set_max_message_size(m_max_message_size);
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.ptr = conn.get();
+            if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                ::close(fd);
+                continue;
+            }
+            conn->m_slot = m_connections.size();
+            m_connections.push_back(std::move(conn));
+        }
+    }
+
+    void reject(Connection& conn) {
+        write(conn, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n"
+                    "Content-Length: 0\r\n\r\n");
+        drop(conn);
+    }
+
+    void upgrade(Connection& conn) {
+        char buf[4096];
+        for (;;) {
+            const ssize_t n = ::recv(conn.m_fd, buf, sizeof(buf), 0);
+            if (n == 0) {
+                drop(conn);
+                return;
+            }
+            if (n < 0) {
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                    drop(conn);
+                break;
+            }
+            const std::size_t searched =
+                conn.m_request.size() - std::min<std::size_t>(
+                                            conn.m_request.size(), 3);
+            conn.m_request.append(buf, n);
+            // anything after the request is left to the frame parser
+            if (conn.m_request.find("\r\n\r\n", searched) !=
+                std::string::npos)
+                break;
+            if (conn.m_request.size() > max_request_size) {
+                reject(conn);
+                return;
+            }
+        }
+        if (conn.m_state == Connection::State::CLOSED)
+            return;
+        const std::size_t end = conn.m_request.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return;
+        const std::string_view request =
+            std::string_view(conn.m_request).substr(0, end + 2);
+        const std::string_view key = find_header(request, "Sec-WebSocket-Key");
+        const std::string_view protocol = find_header(request, "Upgrade");
+        const std::size_t path_start = request.find(' ') + 1;
+        const std::size_t path_end = request.find(' ', path_start);
+        if ((request.substr(0, 4) != "GET ") || key.empty() ||
+            (protocol.size() != 9) || (path_end == std::string_view::npos) ||
+            !std::equal(protocol.begin(), protocol.end(), "websocket",
+                        [](char a, char b) {
+                            return std::tolower((unsigned char)a) == b;
+                        })) {
+            reject(conn);
+            return;
+        }
+        write(conn,
+              build_websocket_handshake_response(websocket_accept_key(key)));
+        if (conn.m_state == Connection::State::CLOSED)
+            return;
+        conn.m_path = request.substr(path_start, path_end - path_start);
+        // frames the client sent without waiting for the response
+        if (end + 4 < conn.m_request.size()) {
+            conn.m_parser.frame_buffer().push_back(
+                std::string_view(conn.m_request).substr(end + 4));
+        }
+        conn.m_request.clear();
+        conn.m_request.shrink_to_fit();
+        conn.m_state = Connection::State::OPEN;
+        m_handler.on_open(*this, conn);
+        handle_frames(conn, true);
+    }
+
+    void close_with(Connection& conn, std::uint16_t code) {
+        conn.close(code);
+        drop(conn);
+    }
+
+    // false once the connection is gone
+    bool handle_frame(Connection& conn, wsframe::Frame frame) {
+        // clients have to mask everything (RFC 6455 section 5.1)
+        if (!frame.mask) {
+            close_with(conn, 1002);
+            return false;
+        }
+        switch (frame.opcode) {
+        case wsframe::Frame::Opcode::TEXT:
+            m_handler.on_text(*this, conn, std::move(frame));
+            break;
+        case wsframe::Frame::Opcode::BINARY:
+            m_handler.on_binary(*this, conn, std::move(frame));
+            break;
+        case wsframe::Frame::Opcode::CONTINUATION:
+            m_handler.on_continuation(*this, conn, std::move(frame));
+            break;
+        case wsframe::Frame::Opcode::PING:
+            if (conn.m_state == Connection::State::OPEN)
+                write(conn, m_factory.pong(false, frame.payload));
+            break;
+        case wsframe::Frame::Opcode::PONG:
+            break;
+        case wsframe::Frame::Opcode::CLOSE:
+            // echo the code back, unless this is the answer to ours
+            if (conn.m_state == Connection::State::OPEN)
+                write(conn, m_factory.close(
+                                false, frame.payload.substr(
+                                           0, std::min<std::size_t>(
+                                                  frame.payload.size(), 2))));
+            drop(conn);
+            return false;
+        default:
+            close_with(conn, 1002);
+            return false;
+        }
+        return conn.m_state != Connection::State::CLOSED;
+    }
+
+    void handle_frames(Connection& conn, bool new_data) {
+        for (auto frame = conn.m_parser.update(new_data); frame.has_value();
+             frame = conn.m_parser.update(false)) {
+            if (!handle_frame(conn, frame.value()))
+                return;
+        }
+        if (conn.m_parser.failed())
+            close_with(conn, 1009);
+    }
+
+    void receive(Connection& conn) {
+        if (conn.m_state == Connection::State::HANDSHAKE) {
+            upgrade(conn);
+            return;
+        }
+        auto& buffer = conn.m_parser.frame_buffer();
+        for (;;) {
+            buffer.ensure_extra_space(max_read_size);
+            const ssize_t n =
+                ::recv(conn.m_fd, buffer.tail(), max_read_size, 0);
+            if (n == 0) {
+                drop(conn);
+                return;
+            }
+            if (n < 0) {
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                    drop(conn);
+                break;
+            }
+            buffer.claim_space(n);
+            handle_frames(conn, true);
+            if (conn.m_state == Connection::State::CLOSED)
+                return;
+            if ((std::size_t)n < max_read_size)
+                break;
+        }
+        if (m_pool)
+            conn.m_parser.release_if_idle();
+    }
+
+  public:
+    // listens on a numeric address, port 0 picks a free port (see port())
+    WSServer(Handler& handler, const std::string& address = "0.0.0.0",
+             long port = 0, const SocketOptions& socket_options = {},
+             int backlog = 128)
+        : m_handler(handler), m_socket_options(socket_options) {
+        const auto addr = ResolvedAddress::from_numeric(address, port);
+        m_listen_fd = ::socket(addr.family(),
+                               SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listen_fd < 0)
+            throw ServerException("Failed to create socket");
+        int one = 1;
+        ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        apply_socket_options(m_listen_fd, addr.family(), m_socket_options);
+        if ((::bind(m_listen_fd, addr.get(), addr.len) != 0) ||
+            (::listen(m_listen_fd, backlog) != 0)) {
+            ::close(m_listen_fd);
+            throw ServerException("Failed to listen on " + address + ":" +
+                                  std::to_string(port));
+        }
+        sockaddr_storage bound;
+        socklen_t len = sizeof(bound);
+        ::getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&bound), &len);
+        m_port = ntohs(bound.ss_family == AF_INET6
+                           ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                           : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+
+        m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        if ((m_epoll_fd < 0) ||
+            (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &ev) != 0)) {
+            ::close(m_listen_fd);
+            if (m_epoll_fd >= 0)
+                ::close(m_epoll_fd);
+            throw ServerException("Failed to set up epoll");
+        }
+    }
+
+    WSServer(const WSServer&) = delete;
+    WSServer& operator=(const WSServer&) = delete;
+
+    ~WSServer() {
+        for (auto& conn : m_connections) {
+            if (conn->m_state != Connection::State::CLOSED)
+                ::close(conn->m_fd);
+        }
+        ::close(m_epoll_fd);
+        ::close(m_listen_fd);
+    }
+
+    long port() const { return m_port; }
+
+    // Accepts, upgrades and reads whatever is ready, waiting up to
+    // timeout_ms for something to be (0 doesn't wait, -1 waits for as long
+    // as it takes). Returns the number of sockets that were ready.
+    int poll(int timeout_ms = 0) {
+        const int ready = ::epoll_wait(m_epoll_fd, m_events.data(),
+                                       (int)m_events.size(), timeout_ms);
+        for (int i = 0; i < ready; i++) {
+            auto* conn = static_cast<Connection*>(m_events[i].data.ptr);
+            if (conn == nullptr) {
+                accept_all();
+                continue;
+            }
+            if (m_events[i].events & EPOLLOUT)
+                flush(*conn);
+            if ((m_events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+                (conn->m_state != Connection::State::CLOSED))
+                receive(*conn);
+        }
+        reap();
+        return std::max(ready, 0);
+    }
+
+    void broadcast_text(std::string_view payload) {
+        broadcast_frame(m_factory.text(true, false, payload));
+    }
+
+    void broadcast_binary(std::string_view payload) {
+        broadcast_frame(m_factory.binary(true, false, payload));
+    }
+
+    // writes the same serialized (unmasked) frame to every open connection
+    void broadcast_frame(std::string_view frame) {
+        for (std::size_t i = 0; i < m_connections.size(); i++) {
+            Connection& conn = *m_connections[i];
+            if (conn.m_state == Connection::State::OPEN)
+                write(conn, frame);
+        }
+    }
+
+    // connections that have finished the upgrade and aren't closing
+    std::size_t connections() const {
+        return std::count_if(m_connections.begin(), m_connections.end(),
+                             [](const auto& conn) { return conn->open(); });
+    }
+
+    // a connection is dropped once it has this many bytes waiting to go out
+    void set_max_backlog(std::size_t max_backlog) {
+        m_max_backlog = max_backlog;
+    }
+
+    // connections are closed with 1009 if a message is bigger than this,
+    // applies to connections accepted from now on
+    void set_max_message_size(std::uint64_t max_message_size) {
+        m_max_message_size = max_message_size;
+    }
+
+    // borrow receive buffers from a pool, so idle connections hold none, the
+    // pool has to outlive the server
+    void use_buffer_pool(BufferPool& pool) { m_pool = &pool; }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_SERVER_HPP_
@@ -0,0 +1,135 @@
+#ifndef _FASTWS_SOCKET_OPTIONS_HPP_
+#define _FASTWS_SOCKET_OPTIONS_HPP_
+
+#include <iostream>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace fastws {
+
+// Per connection socket tuning, applied by the socket wrappers before they
+// connect. Anything left at its default is left alone (apart from
+// TCP_NODELAY, which is on unless turned off). Options the platform doesn't
+// have, or that we aren't allowed to set, are reported on stderr and
+// skipped.
+struct SocketOptions {
+    bool nodelay = true;
+    // SO_RCVBUF/SO_SNDBUF in bytes, 0 for the kernel's autotuning
+    int receive_buffer = 0;
+    int send_buffer = 0;
+    // TCP_QUICKACK, re-armed after every read since the kernel clears it
+    bool quickack = false;
+    // SO_BUSY_POLL in us, spin in the driver for this long on reads
+    int busy_poll = 0;
+    // SO_INCOMING_CPU, ask for packets to be steered to this cpu
+    int incoming_cpu = -1;
+    // IP_TOS / IPV6_TCLASS
+    int tos = -1;
+    // TCP_USER_TIMEOUT in ms, how long sent data can go unacked before the
+    // connection is dropped
+    int user_timeout = 0;
+    // SO_KEEPALIVE and TCP_KEEPIDLE/TCP_KEEPINTVL (s) and TCP_KEEPCNT
+    bool keepalive = false;
+    int keepalive_idle = 0;
+    int keepalive_interval = 0;
+    int keepalive_count = 0;
+};
+
+namespace detail {
+
+template <bool verbose>
+void set_socket_option(int sockfd, int level, int option, int value,
+                       const char* name) {
+    if (::setsockopt(sockfd, level, option, reinterpret_cast<char*>(&value),
+                     sizeof(int)) < 0) {
+        std::cerr << "Error setting " << name << std::endl;
+    } else {
+        if constexpr (verbose) {
+            std::cout << "Set " << name << std::endl;
+        }
+    }
+}
+
+} // namespace detail
+
+// applies options to a socket that hasn't connected yet
+template <bool verbose = false>
+void apply_socket_options(int sockfd, int family,
+                          const SocketOptions& options) {
+    using detail::set_socket_option;
+    if (options.nodelay)
+        set_socket_option<verbose>(sockfd, IPPROTO_TCP, TCP_NODELAY, 1,
+                                   "TCP_NODELAY");
+    // buffer sizes have to be set before connecting to affect the window
+    // scale we advertise
+    if (options.receive_buffer > 0)
+        set_socket_option<verbose>(sockfd, SOL_SOCKET, SO_RCVBUF,
+                                   options.receive_buffer, "SO_RCVBUF");
+    if (options.send_buffer > 0)
+        set_socket_option<verbose>(sockfd, SOL_SOCKET, SO_SNDBUF,
+                                   options.send_buffer, "SO_SNDBUF");
+#ifdef TCP_QUICKACK
+    if (options.quickack)
+        set_socket_option<verbose>(sockfd, IPPROTO_TCP, TCP_QUICKACK, 1,
+                                   "TCP_QUICKACK");
+#endif
+#ifdef SO_BUSY_POLL
+    if (options.busy_poll > 0)
+        set_socket_option<verbose>(sockfd, SOL_SOCKET, SO_BUSY_POLL,
+                                   options.busy_poll, "SO_BUSY_POLL");
+#endif
+#ifdef SO_INCOMING_CPU
+    if (options.incoming_cpu >= 0)
+        set_socket_option<verbose>(sockfd, SOL_SOCKET, SO_INCOMING_CPU,
+                                   options.incoming_cpu, "SO_INCOMING_CPU");
+#endif
+    if (options.tos >= 0) {
+        if (family == AF_INET6) {
+            set_socket_option<verbose>(sockfd, IPPROTO_IPV6, IPV6_TCLASS,
+                                       options.tos, "IPV6_TCLASS");
+        } else {
+            set_socket_option<verbose>(sockfd, IPPROTO_IP, IP_TOS, options.tos,
+                                       "IP_TOS");
+        }
+    }
+#ifdef TCP_USER_TIMEOUT
+    if (options.user_timeout > 0)
+        set_socket_option<verbose>(sockfd, IPPROTO_TCP, TCP_USER_TIMEOUT,
+                                   options.user_timeout, "TCP_USER_TIMEOUT");
+#endif
+    if (options.keepalive) {
+        set_socket_option<verbose>(sockfd, SOL_SOCKET, SO_KEEPALIVE, 1,
+                                   "SO_KEEPALIVE");
+#ifdef TCP_KEEPIDLE
+        if (options.keepalive_idle > 0)
+            set_socket_option<verbose>(sockfd, IPPROTO_TCP, TCP_KEEPIDLE,
+                                       options.keepalive_idle, "TCP_KEEPIDLE");
+#endif
+        if (options.keepalive_interval > 0)
+            set_socket_option<verbose>(sockfd, IPPROTO_TCP, TCP_KEEPINTVL,
+                                       options.keepalive_interval,
+                                       "TCP_KEEPINTVL");
+        if (options.keepalive_count > 0)
+            set_socket_option<verbose>(sockfd, IPPROTO_TCP, TCP_KEEPCNT,
+                                       options.keepalive_count, "TCP_KEEPCNT");
+    }
+}
+
+// the kernel drops out of quickack mode on its own, so this has to be
+// called again after reads
+inline void rearm_quickack(int sockfd) {
+#ifdef TCP_QUICKACK
+    int flag = 1;
+    ::setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK,
+                 reinterpret_cast<char*>(&flag), sizeof(int));
+#else
+    (void)sockfd;
+#endif
+}
+
+} // namespace fastws
+
+#endif // _FASTWS_SOCKET_OPTIONS_HPP_
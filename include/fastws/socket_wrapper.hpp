@@ -1,15 +1,19 @@
 #ifndef _FASTWS_SOCKET_WRAPPER_HPP_
 #define _FASTWS_SOCKET_WRAPPER_HPP_
 
+#include "buffer_pool.hpp"
+#include "connection_stats.hpp"
+#include "resolver.hpp"
+#include "socket_options.hpp"
+#include "tls_engine.hpp"
 #include "wsframe/wsframe.hpp"
 
-#include <boost/pool/pool_alloc.hpp>
-
 #include <algorithm>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <arpa/inet.h>
 #include <fcntl.h>
@@ -18,140 +22,392 @@
 #include <netinet/tcp.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 namespace fastws {
 
-// messages are returned as a fastrest::string which uses a pool allocator
-using string = std::basic_string<char, std::char_traits<char>,
-                                 boost::fast_pool_allocator<char>>;
-
 class SSLSocketWrapperException : public std::runtime_error {
   public:
     explicit SSLSocketWrapperException(const std::string& msg)
         : std::runtime_error(msg) {}
 };
 
+// every connection shares one SSL_CTX instead of creating their own, each
+// caller owns a reference and should SSL_CTX_free it
+inline SSL_CTX* shared_ssl_ctx() {
+    static SSL_CTX* ctx = [] {
+        SSL_CTX* out = SSL_CTX_new(TLS_client_method());
+        if (out)
+            TLSSessionCache::install(out);
+        return out;
+    }();
+    if (!ctx)
+        throw SSLSocketWrapperException("Failed to create SSL_CTX.");
+    SSL_CTX_up_ref(ctx);
+    return ctx;
+}
+
+namespace detail {
+
+// opens a socket connected to the first address that accepts, or returns -1
+template <bool verbose>
+int connect_any(const AddressList& addrs, const SocketOptions& options) {
+    for (const auto& addr : addrs) {
+        int sockfd = ::socket(addr.family(), SOCK_STREAM, IPPROTO_TCP);
+        if (sockfd == -1)
+            continue;
+
+        apply_socket_options<verbose>(sockfd, addr.family(), options);
+
+        if (::connect(sockfd, addr.get(), addr.len) == 0)
+            return sockfd;
+
+        ::close(sockfd);
+    }
+    return -1;
+}
+
+// TCP connect race: starts a non-blocking connect to (up to max_race of)
+// addrs at once and keeps whichever finishes first, i.e. the one with the
+// lowest network RTT to us. Only the TCP handshake is timed, TLS and the
+// WebSocket handshake happen afterwards on the winner. The rest are closed.
+// Each connect that fails makes room for the next address, and addresses
+// never started by the timeout are tried one at a time after it (as
+// connect_any() would). Returns a blocking socket, or -1 if nothing
+// connected. The index of the winner and how long its connect took are
+// written to winner/connect_ns.
+template <bool verbose>
+int race_connect(const AddressList& addrs, const SocketOptions& options,
+                 std::size_t& winner, std::uint64_t& connect_ns,
+                 std::size_t max_race = 4, int timeout_ms = 10000) {
+    std::vector<pollfd> fds;
+    std::vector<std::size_t> index;
+    const std::uint64_t start = clock::now_ns();
+    int out = -1;
+    std::size_t next = 0;
+    // starts a connect to the next address, false once none are left
+    const auto start_next = [&]() {
+        while (next < addrs.size()) {
+            const std::size_t i = next++;
+            int sockfd = ::socket(addrs[i].family(), SOCK_STREAM, IPPROTO_TCP);
+            if (sockfd == -1)
+                continue;
+            apply_socket_options<verbose>(sockfd, addrs[i].family(), options);
+            fcntl(sockfd, F_SETFL, O_NONBLOCK);
+            if (::connect(sockfd, addrs[i].get(), addrs[i].len) == 0) {
+                // loopback can connect straight away
+                out = sockfd;
+                winner = i;
+                return true;
+            }
+            if (errno != EINPROGRESS) {
+                ::close(sockfd);
+                continue;
+            }
+            fds.push_back({sockfd, POLLOUT, 0});
+            index.push_back(i);
+            return true;
+        }
+        return false;
+    };
+    while ((out == -1) && (fds.size() < max_race) && start_next()) {
+    }
+
+    const std::uint64_t deadline = start + std::uint64_t(timeout_ms) * 1000000;
+    while ((out == -1) && (!fds.empty())) {
+        const std::uint64_t now = clock::now_ns();
+        if (now >= deadline)
+            break;
+        const int wait_ms = (int)((deadline - now + 999999) / 1000000);
+        const int n = ::poll(fds.data(), fds.size(), wait_ms);
+        if ((n < 0) && (errno != EINTR))
+            break;
+        for (std::size_t k = 0; k < fds.size();) {
+            if (fds[k].revents == 0) {
+                k++;
+                continue;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fds[k].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            const bool won = (err == 0) && (out == -1);
+            if (won) {
+                out = fds[k].fd;
+                winner = index[k];
+            } else {
+                ::close(fds[k].fd);
+            }
+            fds[k] = fds.back();
+            fds.pop_back();
+            index[k] = index.back();
+            index.pop_back();
+            // a new connect comes in at the back, not ready yet
+            if (!won && (out == -1))
+                start_next();
+        }
+    }
+    for (auto& fd : fds) {
+        ::close(fd.fd);
+    }
+    // out of time with addresses that never got a turn
+    for (; (out == -1) && (next < addrs.size()); next++) {
+        out = connect_any<verbose>(AddressList{addrs[next]}, options);
+        winner = next;
+    }
+    if (out == -1)
+        return -1;
+
+    connect_ns = clock::now_ns() - start;
+    if constexpr (verbose) {
+        std::cout << "Connected to " << addrs[winner].to_string() << " in "
+                  << connect_ns * 0.001 << "us" << std::endl;
+    }
+    fcntl(out, F_SETFL, fcntl(out, F_GETFL) & ~O_NONBLOCK);
+    return out;
+}
+
+// Connects to host through the resolver. The first time a host with more
+// than one address is seen their TCP connects are raced (for up to
+// timeout_ms), and the winner is recorded with the resolver so reconnects
+// go straight to it (falling back to the others in order).
+template <bool verbose>
+int connect_host(const std::string& host, long port, Resolver& resolver,
+                 const SocketOptions& options, int timeout_ms = 10000) {
+    auto addrs = resolver.resolve(host, port);
+    int sockfd = -1;
+    if ((addrs->size() > 1) && (!resolver.preferred(host, port))) {
+        std::size_t winner = 0;
+        std::uint64_t connect_ns = 0;
+        sockfd = race_connect<verbose>(*addrs, options, winner, connect_ns,
+                                       4, timeout_ms);
+        if (sockfd != -1)
+            resolver.prefer(host, port, (*addrs)[winner], connect_ns);
+    } else {
+        sockfd = connect_any<verbose>(*addrs, options);
+    }
+    // none of the addresses worked, look them up again next time
+    if (sockfd == -1)
+        resolver.invalidate(host, port);
+    return sockfd;
+}
+
+} // namespace detail
+
+// TLS over a socket through a TLSEngine. Ciphertext is read from the socket
+// in batches of up to TLSEngine::default_incoming_size, so a burst of small
+// records costs one recv rather than one (or more) per record, and is
+// decrypted straight into the caller's buffer.
 template <bool verbose = false> class SSLSocketWrapper {
   private:
     // the url of the host we are making requests to
     std::string m_host;
     long m_port;
 
+    // re-arm TCP_QUICKACK after reads
+    bool m_quickack = false;
+
     // socket
     int m_sockfd = -1;
 
-    // ssl socket, the thing we actually use
-    int m_sslsock = -1;
+    TLSEngine m_engine;
 
-    // ssl shit
-    SSL_CTX* m_ctx = nullptr;
-    SSL* m_ssl = nullptr;
+    PooledBuffer m_out;
 
-    string m_out;
+    // syscall counters to update, if there are any (see set_stats)
+    ConnectionStats* m_stats = nullptr;
 
-    // dumb way to print ssl errors
-    std::string get_ssl_error() {
-        std::string out = "";
-        int err;
-        while ((err = ERR_get_error())) {
-            char* str = ERR_error_string(err, 0);
-            if (str)
-                out += std::string(str);
-        }
-        return out;
+    void count(StatCounter ConnectionStats::*counter,
+               std::uint64_t n = 1) const {
+        if (m_stats)
+            (m_stats->*counter).add(n);
     }
 
-    void connect() {
-        // reserve 1000 bytes for the out thingy
-        m_out.reserve(1000);
-
-        // lots of boring socket config stuff, so much boilerplate
-        struct addrinfo hints = {}, *addrs;
-
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_protocol = IPPROTO_TCP;
-
-        if (int rc = getaddrinfo(m_host.c_str(), std::to_string(m_port).c_str(),
-                                 &hints, &addrs);
-            rc != 0) {
-            throw SSLSocketWrapperException(std::string(gai_strerror(rc)));
+    // Reads whatever ciphertext the socket has into the engine, false if
+    // there was nothing. With a deadline (ns on fastws::clock, 0 for none),
+    // blocks until something arrives and throws once the deadline passes
+    // (only used for the handshake).
+    bool receive(std::uint64_t deadline = 0) {
+        const bool wait = deadline != 0;
+        std::size_t len = 0;
+        char* buf = m_engine.incoming_space(len);
+        if (len == 0)
+            return false;
+        ssize_t ret;
+        while ((ret = ::recv(m_sockfd, buf, len, 0)) < 0) {
+            count(&ConnectionStats::recv_calls);
+            if (errno == EINTR)
+                continue;
+            if (!(errno == EAGAIN || errno == EWOULDBLOCK))
+                throw SSLSocketWrapperException("recv() failed: " +
+                                                std::to_string(errno));
+            count(&ConnectionStats::would_block);
+            if (!wait)
+                return false;
+            const std::uint64_t now = clock::now_ns();
+            if (now >= deadline)
+                throw SSLSocketWrapperException("TLS handshake timed out.");
+            pollfd pfd = {m_sockfd, POLLIN, 0};
+            ::poll(&pfd, 1, (int)((deadline - now + 999999) / 1000000));
         }
+        count(&ConnectionStats::recv_calls);
+        if (ret == 0) {
+            if (wait)
+                throw SSLSocketWrapperException("Connection closed.");
+            return false;
+        }
+        m_engine.commit_incoming(ret);
+        count(&ConnectionStats::socket_bytes_in, ret);
+        if (m_quickack)
+            rearm_quickack(m_sockfd);
+        return true;
+    }
 
-        for (addrinfo* addr = addrs; addr != NULL; addr = addr->ai_next) {
-            m_sockfd =
-                socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-
-            if (m_sockfd == -1)
-                break;
-
-            // set nonblocking socket flag
-            int flag = 1;
-            if (setsockopt(m_sockfd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag,
-                           sizeof(int)) < 0) {
-                std::cerr << "Error setting TCP_NODELAY" << std::endl;
-            } else {
-                if constexpr (verbose) {
-                    std::cout << "Set TCP_NODELAY" << std::endl;
+    // sends everything the engine has queued, waiting for room in the
+    // socket if we have to
+    void flush() {
+        for (auto out = m_engine.outgoing(); !out.empty();
+             out = m_engine.outgoing()) {
+            const ssize_t ret = ::send(m_sockfd, out.data(), out.size(), 0);
+            count(&ConnectionStats::send_calls);
+            if (ret < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    count(&ConnectionStats::would_block);
+                    pollfd pfd = {m_sockfd, POLLOUT, 0};
+                    ::poll(&pfd, 1, -1);
+                    continue;
                 }
+                if (errno == EINTR)
+                    continue;
+                throw SSLSocketWrapperException("send() failed: " +
+                                                std::to_string(errno));
             }
+            m_engine.consume_outgoing(ret);
+            count(&ConnectionStats::socket_bytes_out, ret);
+        }
+    }
 
-            // try and connect
-            if (::connect(m_sockfd, addr->ai_addr, addr->ai_addrlen) == 0)
-                break;
+    // decrypts what we already have, only going to the socket when that
+    // runs dry
+    template <class Buffer>
+    std::size_t decrypt_into(Buffer& buffer, std::size_t len) {
+        std::size_t read = m_engine.read_into(buffer, len);
+        if ((read == 0) && receive())
+            read = m_engine.read_into(buffer, len);
+        // reads can make OpenSSL want to say something back (key updates)
+        if (m_engine.has_outgoing())
+            flush();
+        return read;
+    }
 
-            close(m_sockfd);
-            m_sockfd = -1;
+    // Sends as much of early_data as the session allows along with the
+    // ClientHello, and returns how much that was.
+    std::size_t send_early_data(std::string_view early_data) {
+        std::size_t sent = 0;
+        if (early_data.size() > m_engine.max_early_data())
+            return 0;
+        while (sent < early_data.size()) {
+            const std::size_t n =
+                m_engine.write_early_data(early_data.substr(sent));
+            if (n == 0)
+                break;
+            sent += n;
+            flush();
         }
+        return sent;
+    }
+
+    void connect(int sockfd, std::string_view early_data, int timeout_ms) {
+        // reserve 1000 bytes for the out thingy
+        m_out.ensure_fit(1000);
 
+        m_sockfd = sockfd;
         if (m_sockfd == -1)
             throw SSLSocketWrapperException("Failed to connect to server.");
 
-        // ssl boilerplate
-        const SSL_METHOD* meth = TLS_client_method();
-        m_ctx = SSL_CTX_new(meth);
-        m_ssl = SSL_new(m_ctx);
-
-        if (!m_ssl)
-            throw SSLSocketWrapperException("Failed to create SSL.");
-
-        SSL_set_tlsext_host_name(m_ssl, m_host.c_str());
-
-        m_sslsock = SSL_get_fd(m_ssl);
-        SSL_set_fd(m_ssl, m_sockfd);
-
-        if (SSL_connect(m_ssl) <= 0) {
-            throw SSLSocketWrapperException(get_ssl_error());
+        // non-blocking from here on, so a server that takes the connection
+        // but never answers can't hold the handshake up past timeout_ms
+        fcntl(m_sockfd, F_SETFL, O_NONBLOCK);
+        const std::uint64_t deadline =
+            clock::now_ns() + std::uint64_t(timeout_ms) * 1000000;
+        SSL_CTX* ctx = shared_ssl_ctx();
+        try {
+            m_engine = TLSEngine(ctx, m_host);
+            m_engine.use_session_cache(TLSSessionCache::global(),
+                                       TLSSessionCache::key(m_host, m_port));
+            const std::size_t early = send_early_data(early_data);
+            while (!m_engine.handshake()) {
+                flush();
+                receive(deadline);
+            }
+            flush();
+            // whatever the server didn't take as early data goes again
+            if (!m_engine.early_data_accepted()) {
+                send(early_data);
+            } else if (early < early_data.size()) {
+                send(early_data.substr(early));
+            }
+        } catch (const TLSEngineException& e) {
+            SSL_CTX_free(ctx);
+            disconnect();
+            throw SSLSocketWrapperException(e.what());
+        } catch (...) {
+            // the destructor won't run for a constructor that throws
+            SSL_CTX_free(ctx);
+            disconnect();
+            throw;
         }
+        SSL_CTX_free(ctx);
 
         if constexpr (verbose) {
-            std::cout << "SSL connection using " << SSL_get_cipher(m_ssl)
+            std::cout << "SSL connection using " << m_engine.cipher()
+                      << (m_engine.resumed() ? " (resumed" : " (new")
+                      << (m_engine.early_data_accepted() ? ", 0-RTT)" : ")")
                       << std::endl;
         }
-
-        freeaddrinfo(addrs);
-
-        fcntl(m_sockfd, F_SETFL, O_NONBLOCK);
     }
 
     void disconnect() {
+        if (m_engine && !(m_sockfd < 0)) {
+            // best effort close_notify, we aren't waiting around for it
+            m_engine.shutdown();
+            auto out = m_engine.outgoing();
+            if (!out.empty())
+                (void)!::send(m_sockfd, out.data(), out.size(), MSG_DONTWAIT);
+        }
         if (!(m_sockfd < 0))
             close(m_sockfd);
-        if (m_ctx)
-            SSL_CTX_free(m_ctx);
-        if (m_ssl) {
-            SSL_shutdown(m_ssl);
-            SSL_free(m_ssl);
-        }
+        m_engine = TLSEngine();
+        m_sockfd = -1;
     }
 
   public:
-    SSLSocketWrapper(const std::string host, const long port = 443)
-        : m_host(host), m_port(port) {
-        connect();
+    // Resolves host through the resolver (cached after the first lookup).
+    // early_data is sent as soon as possible: with the ClientHello (0-RTT)
+    // when resuming a session from TLSSessionCache::global() that allows
+    // it, otherwise straight after the handshake. Throws if the connect
+    // race or the TLS handshake takes longer than timeout_ms.
+    SSLSocketWrapper(const std::string host, const long port = 443,
+                     Resolver& resolver = Resolver::global(),
+                     const SocketOptions& options = {},
+                     std::string_view early_data = {}, int timeout_ms = 10000)
+        : m_host(host), m_port(port), m_quickack(options.quickack) {
+        connect(detail::connect_host<verbose>(host, port, resolver, options,
+                                              timeout_ms),
+                early_data, timeout_ms);
+    }
+
+    // connects straight to addrs, host is only used for SNI
+    SSLSocketWrapper(const std::string host, const long port,
+                     const AddressList& addrs,
+                     const SocketOptions& options = {},
+                     std::string_view early_data = {}, int timeout_ms = 10000)
+        : m_host(host), m_port(port), m_quickack(options.quickack) {
+        connect(detail::connect_any<verbose>(addrs, options), early_data,
+                timeout_ms);
     }
 
     SSLSocketWrapper() {}
@@ -160,85 +416,104 @@ template <bool verbose = false> class SSLSocketWrapper {
     SSLSocketWrapper& operator=(const SSLSocketWrapper&) = delete;
 
     SSLSocketWrapper(SSLSocketWrapper&& other)
-        : m_host(std::move(other.m_host)), m_sockfd(other.m_sockfd),
-          m_sslsock(other.m_sslsock), m_ctx(other.m_ctx), m_ssl(other.m_ssl),
-          m_out(std::move(other.m_out)) {
+        : m_host(std::move(other.m_host)), m_port(other.m_port),
+          m_quickack(other.m_quickack), m_sockfd(other.m_sockfd),
+          m_engine(std::move(other.m_engine)), m_out(std::move(other.m_out)),
+          m_stats(other.m_stats) {
         other.m_sockfd = -1;
-        other.m_sslsock = -1;
-        other.m_ctx = nullptr;
-        other.m_ssl = nullptr;
     }
 
     SSLSocketWrapper& operator=(SSLSocketWrapper&& other) {
         disconnect();
 
         m_host = std::move(other.m_host);
+        m_port = other.m_port;
+        m_quickack = other.m_quickack;
         m_sockfd = other.m_sockfd;
-        m_sslsock = other.m_sslsock;
-        m_ctx = other.m_ctx;
-        m_ssl = other.m_ssl;
+        m_engine = std::move(other.m_engine);
         m_out = std::move(other.m_out);
+        m_stats = other.m_stats;
 
         other.m_sockfd = -1;
-        other.m_sslsock = -1;
-        other.m_ctx = nullptr;
-        other.m_ssl = nullptr;
 
         return *this;
     }
 
     // sends a request - forces the socket to fully send everything
     int send(std::string_view req) {
-        const char* buf = req.data();
-        int to_send = req.length();
-        int sent = 0;
-        while (to_send > 0) {
-            const int len = SSL_write(m_ssl, buf + sent, to_send);
-            if (len < 0) {
-                int err = SSL_get_error(m_ssl, len);
-                switch (err) {
-                case SSL_ERROR_WANT_WRITE:
-                    throw SSLSocketWrapperException("SSL_ERROR_WANT_WRITE");
-                case SSL_ERROR_WANT_READ:
-                    throw SSLSocketWrapperException("SSL_ERROR_WANT_READ");
-                case SSL_ERROR_ZERO_RETURN:
-                    throw SSLSocketWrapperException("SSL_ERROR_ZERO_RETURN");
-                case SSL_ERROR_SYSCALL:
-                    throw SSLSocketWrapperException("SSL_ERROR_SYSCALL");
-                case SSL_ERROR_SSL:
-                    throw SSLSocketWrapperException("SSL_ERROR_SSL");
-                default:
-                    throw SSLSocketWrapperException("UNKNOWN SSL ERROR");
-                }
+        std::size_t sent = 0;
+        try {
+            while (sent < req.size()) {
+                sent += m_engine.write(req.substr(sent));
+                flush();
             }
-            to_send -= len;
-            sent += len;
+        } catch (const TLSEngineException& e) {
+            throw SSLSocketWrapperException(e.what());
         }
         return sent;
     }
 
     std::string_view read(const size_t read_size = 100) {
-        m_out.clear();
-        size_t read = 0;
-        const size_t original_size = m_out.size();
-        m_out.resize(original_size + read_size);
-        char* buf = &(m_out.data()[original_size]);
-        SSL_read_ex(m_ssl, buf, read_size, &read);
-        m_out.resize(original_size + read);
-        return m_out;
+        m_out.reset();
+        m_out.ensure_fit(read_size);
+        std::size_t read = m_engine.read(m_out.head(), read_size);
+        if ((read == 0) && receive())
+            read = m_engine.read(m_out.head(), read_size);
+        if (m_engine.has_outgoing())
+            flush();
+        m_out.claim_space(read);
+        return m_out.view();
     }
 
-    bool read_into(wsframe::FrameBuffer& frame_buffer,
+    // Buffer is wsframe::FrameBuffer or anything with the same interface
+    template <class Buffer>
+    bool read_into(Buffer& frame_buffer,
                    const std::size_t chunk_size_hint = 1024) {
-        std::size_t read = 0;
-        bool new_data = false;
-        frame_buffer.ensure_extra_space(chunk_size_hint);
-        auto* buf = frame_buffer.tail();
-        SSL_read_ex(m_ssl, buf, chunk_size_hint, &read);
-        if (read > 0)
-            new_data = true;
-        frame_buffer.claim_space(read);
-        return new_data;
+        return decrypt_into(frame_buffer, chunk_size_hint) > 0;
+    }
+
+    int fd() const { return m_sockfd; }
+
+    // counts syscalls and socket bytes into stats from now on (nullptr to
+    // stop), it has to outlive the socket
+    void set_stats(ConnectionStats* stats) { m_stats = stats; }
+
+    TLSEngine& engine() { return m_engine; }
+
+    // the handshake resumed a cached session
+    bool resumed() const { return m_engine.resumed(); }
+
+    // the early data passed to the constructor went out with the ClientHello
+    bool early_data_accepted() const { return m_engine.early_data_accepted(); }
+
+    // whether we have data (decrypted, or complete records still to be
+    // decrypted) that a read would return without going to the socket
+    bool has_pending() const { return m_engine.has_pending(); }
+
+    // what we have buffered plus bytes waiting in the kernel, roughly how
+    // much the next reads can return
+    std::size_t available() const {
+        int queued = 0;
+        count(&ConnectionStats::ioctl_calls);
+        if ((m_sockfd < 0) || (::ioctl(m_sockfd, FIONREAD, &queued) < 0))
+            queued = 0;
+        // a partial record doesn't count until the rest of it arrives
+        const std::size_t buffered =
+            m_engine.has_pending()
+                ? m_engine.pending() + m_engine.buffered_ciphertext()
+                : 0;
+        return buffered + queued;
+    }
+
+    // memory held by the read() buffer and the engine's ciphertext buffers
+    std::size_t buffer_capacity() const {
+        return m_out.capacity() + m_engine.buffer_size();
+    }
+
+    // frees the read() buffer, which is only needed for the handshake
+    void shrink() {
+        m_out.reset();
+        m_out.release();
     }
 
     ~SSLSocketWrapper() { disconnect(); }
@@ -255,63 +530,30 @@ template <bool verbose = false> class SocketWrapper {
     std::string m_host;
     long m_port;
 
+    // re-arm TCP_QUICKACK after reads
+    bool m_quickack = false;
+
     // raw TCP socket
     int m_sockfd = -1;
 
     // buffer for storing read results
-    string m_out;
-
-    void connect() {
-        // optional pre-allocation for m_out
-        m_out.reserve(1000);
-
-        // set up hints for getaddrinfo
-        struct addrinfo hints = {}, *addrs = nullptr;
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_protocol = IPPROTO_TCP;
-
-        if (int rc = getaddrinfo(m_host.c_str(), std::to_string(m_port).c_str(),
-                                 &hints, &addrs);
-            rc != 0) {
-            throw SocketWrapperException(std::string(gai_strerror(rc)));
-        }
+    PooledBuffer m_out;
 
-        bool connected = false;
-        for (addrinfo* addr = addrs; addr != NULL; addr = addr->ai_next) {
-            // create socket
-            m_sockfd =
-                ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-            if (m_sockfd == -1) {
-                continue; // try next address
-            }
-
-            // set TCP_NODELAY
-            int flag = 1;
-            if (::setsockopt(m_sockfd, IPPROTO_TCP, TCP_NODELAY,
-                             reinterpret_cast<char*>(&flag), sizeof(int)) < 0) {
-                std::cerr << "Error setting TCP_NODELAY" << std::endl;
-            } else {
-                if constexpr (verbose) {
-                    std::cout << "Set TCP_NODELAY" << std::endl;
-                }
-            }
-
-            // attempt connect
-            if (::connect(m_sockfd, addr->ai_addr, addr->ai_addrlen) == 0) {
-                // success
-                connected = true;
-                break;
-            }
+    // syscall counters to update, if there are any (see set_stats)
+    ConnectionStats* m_stats = nullptr;
 
-            // if connect fails, close socket and try next
-            ::close(m_sockfd);
-            m_sockfd = -1;
-        }
+    void count(StatCounter ConnectionStats::*counter,
+               std::uint64_t n = 1) const {
+        if (m_stats)
+            (m_stats->*counter).add(n);
+    }
 
-        freeaddrinfo(addrs);
+    void connect(int sockfd) {
+        // optional pre-allocation for m_out
+        m_out.ensure_fit(1000);
 
-        if (!connected || m_sockfd == -1) {
+        m_sockfd = sockfd;
+        if (m_sockfd == -1) {
             throw SocketWrapperException("Failed to connect to server.");
         }
 
@@ -327,9 +569,26 @@ template <bool verbose = false> class SocketWrapper {
     }
 
   public:
-    SocketWrapper(const std::string& host, long port = 80)
-        : m_host(host), m_port(port) {
-        connect();
+    // resolves host through the resolver (cached after the first lookup),
+    // early_data is sent as soon as we are connected. timeout_ms bounds the
+    // connect race.
+    SocketWrapper(const std::string& host, long port = 80,
+                  Resolver& resolver = Resolver::global(),
+                  const SocketOptions& options = {},
+                  std::string_view early_data = {}, int timeout_ms = 10000)
+        : m_host(host), m_port(port), m_quickack(options.quickack) {
+        connect(detail::connect_host<verbose>(host, port, resolver, options,
+                                              timeout_ms));
+        send(early_data);
+    }
+
+    // connects straight to addrs without looking anything up
+    SocketWrapper(const std::string& host, long port,
+                  const AddressList& addrs, const SocketOptions& options = {},
+                  std::string_view early_data = {}, int = 10000)
+        : m_host(host), m_port(port), m_quickack(options.quickack) {
+        connect(detail::connect_any<verbose>(addrs, options));
+        send(early_data);
     }
 
     SocketWrapper() {}
@@ -339,7 +598,8 @@ template <bool verbose = false> class SocketWrapper {
 
     SocketWrapper(SocketWrapper&& other)
         : m_host(std::move(other.m_host)), m_port(other.m_port),
-          m_sockfd(other.m_sockfd), m_out(std::move(other.m_out)) {
+          m_quickack(other.m_quickack), m_sockfd(other.m_sockfd),
+          m_out(std::move(other.m_out)), m_stats(other.m_stats) {
         other.m_sockfd = -1;
     }
 
@@ -348,8 +608,10 @@ template <bool verbose = false> class SocketWrapper {
 
         m_host = std::move(other.m_host);
         m_port = other.m_port;
+        m_quickack = other.m_quickack;
         m_sockfd = other.m_sockfd;
         m_out = std::move(other.m_out);
+        m_stats = other.m_stats;
 
         other.m_sockfd = -1;
         return *this;
@@ -365,9 +627,11 @@ template <bool verbose = false> class SocketWrapper {
 
         while (to_send > 0) {
             ssize_t ret = ::send(m_sockfd, buf + total_sent, to_send, 0);
+            count(&ConnectionStats::send_calls);
             if (ret < 0) {
                 // handle EAGAIN if non-blocking
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    count(&ConnectionStats::would_block);
                     // either wait or throw
                     throw SocketWrapperException("Socket would block on send");
                 }
@@ -375,6 +639,7 @@ template <bool verbose = false> class SocketWrapper {
             }
             to_send -= ret;
             total_sent += ret;
+            count(&ConnectionStats::socket_bytes_out, ret);
         }
         return total_sent;
     }
@@ -384,48 +649,85 @@ template <bool verbose = false> class SocketWrapper {
     // if no data is available, returns empty.
     // if the socket is closed or error, might throw or return partial.
     std::string_view read(std::size_t chunk_size = 1024) {
-        m_out.clear();
-        // expand buffer
-        std::size_t old_size = m_out.size();
-        m_out.resize(old_size + chunk_size);
-        char* buf = &m_out[old_size];
+        m_out.reset();
+        // expand buffer, without zeroing it
+        m_out.ensure_fit(chunk_size);
 
         // read from socket
-        ssize_t ret = ::recv(m_sockfd, buf, chunk_size, 0);
+        ssize_t ret = ::recv(m_sockfd, m_out.head(), chunk_size, 0);
+        count(&ConnectionStats::recv_calls);
         if (ret < 0) {
             // handle EAGAIN or EWOULDBLOCK if non-blocking
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                m_out.resize(old_size);
-            } else {
+            if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
                 throw SocketWrapperException("recv() failed: " +
                                              std::to_string(errno));
             }
-        } else if (ret == 0) {
-            m_out.resize(old_size);
-        } else {
-            m_out.resize(old_size + ret);
+            count(&ConnectionStats::would_block);
+        } else if (ret > 0) {
+            m_out.claim_space(ret);
+            count(&ConnectionStats::socket_bytes_in, ret);
+            if (m_quickack)
+                rearm_quickack(m_sockfd);
         }
-        return m_out;
+        return m_out.view();
     }
 
-    bool read_into(wsframe::FrameBuffer& frame_buffer,
+    template <class Buffer>
+    bool read_into(Buffer& frame_buffer,
                    const std::size_t chunk_size_hint = 1024) {
         bool new_data = false;
         frame_buffer.ensure_extra_space(chunk_size_hint);
         auto* buf = frame_buffer.tail();
 
         ssize_t ret = ::recv(m_sockfd, buf, chunk_size_hint, 0);
+        count(&ConnectionStats::recv_calls);
         if (ret < 0) {
             if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
                 throw SocketWrapperException("recv() failed: " +
                                              std::to_string(errno));
             }
+            count(&ConnectionStats::would_block);
         } else if (ret > 0) {
             new_data = true;
             frame_buffer.claim_space(ret);
+            count(&ConnectionStats::socket_bytes_in, ret);
+            if (m_quickack)
+                rearm_quickack(m_sockfd);
         }
         return new_data;
     }
+
+    int fd() const { return m_sockfd; }
+
+    // counts syscalls and socket bytes into stats from now on (nullptr to
+    // stop), it has to outlive the socket
+    void set_stats(ConnectionStats* stats) { m_stats = stats; }
+
+    // nothing is buffered above the kernel for plain sockets
+    bool has_pending() const { return false; }
+
+    // no TLS, so nothing to resume and nothing goes out early
+    bool resumed() const { return false; }
+
+    bool early_data_accepted() const { return false; }
+
+    // bytes waiting in the kernel, 0 means a read would find nothing
+    std::size_t available() const {
+        int queued = 0;
+        count(&ConnectionStats::ioctl_calls);
+        if ((m_sockfd < 0) || (::ioctl(m_sockfd, FIONREAD, &queued) < 0))
+            return 0;
+        return queued;
+    }
+
+    // memory held by the read() buffer
+    std::size_t buffer_capacity() const { return m_out.capacity(); }
+
+    // frees the read() buffer, which is only needed for the handshake
+    void shrink() {
+        m_out.reset();
+        m_out.release();
+    }
 };
 
 } // namespace fastws
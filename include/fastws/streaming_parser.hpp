@@ -0,0 +1,328 @@
+#ifndef _FASTWS_STREAMING_PARSER_HPP_
+#define _FASTWS_STREAMING_PARSER_HPP_
+
+#include "buffer_pool.hpp"
+#include "fixed_buffer.hpp"
+#include "mask.hpp"
+#include "wsframe/wsframe.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace fastws {
+
+// Frame parser in the style of wsframe::FrameParser that can hand out the
+// payload of large frames in pieces as they arrive, instead of buffering the
+// whole thing. Frames with payloads of at most max_buffered_payload bytes are
+// returned whole as usual. Bigger frames come back as a sequence of chunks
+// (streaming() is true) that all carry the header of the frame, the last of
+// which has last_chunk() set. Chunks are only valid until the next update().
+// Messages (all the fragments together) bigger than max_message_size put the
+// parser in a failed() state without buffering anything. Payloads of masked
+// frames (i.e. frames from a client) are unmasked in place, unless
+// Unmasking is false, when they are left as they came.
+//
+// MaxPayload bounds frames at compile time (to at least 125 bytes, so
+// control frames always fit). Anything bigger puts the parser in the failed()
+// state, and the length encodings it can't need (16 and 64 bit) aren't
+// compiled in.
+//
+// With set_defer_compaction(true), bytes that have been parsed stay at the
+// front of the buffer until compact(), rather than the rest being moved down
+// after every frame. Everything returned since the last compact() stays
+// valid, and a buffer holding n frames is moved once instead of n times.
+// The owner has to compact() before reading more into the buffer.
+template <class Buffer, bool Unmasking = true,
+          std::uint64_t MaxPayload = std::numeric_limits<std::uint64_t>::max()>
+class BasicStreamingFrameParser {
+  private:
+    static constexpr std::uint64_t frame_limit =
+        std::max<std::uint64_t>(MaxPayload, 125);
+
+    enum class ParseStage { HEADER, PAYLOAD_DATA, PAYLOAD_STREAM, DONE, ERROR };
+    ParseStage m_parse_stage = ParseStage::HEADER;
+    wsframe::Frame m_frame = {};
+    Buffer m_frame_buffer;
+    // for streamed frames, how much of the payload we haven't seen yet
+    std::uint64_t m_payload_len = 0;
+    // how much of a masked payload has been unmasked, for streamed frames
+    std::uint64_t m_mask_offset = 0;
+    std::size_t m_ptr = 0;
+    std::uint64_t m_max_buffered_payload =
+        std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t m_max_message_size =
+        std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t m_message_size = 0;
+    bool m_streaming = false;
+    bool m_first_chunk = false;
+    bool m_last_chunk = false;
+    // last parse() ran out of bytes, no point trying again without new data
+    bool m_waiting = false;
+    bool m_defer_compaction = false;
+
+    std::size_t remaining() const { return m_frame_buffer.size() - m_ptr; }
+
+    const std::uint8_t* cursor() const { return m_frame_buffer.head() + m_ptr; }
+
+    void check_header() {
+        if ((m_parse_stage != ParseStage::HEADER) || (remaining() < 2))
+            return;
+        const std::uint8_t* buf = cursor();
+        const std::uint8_t len = buf[1] & 0x7F;
+        const bool mask = buf[1] & 0x80;
+        std::size_t header_len = 2 + (mask ? 4 : 0);
+        if constexpr (frame_limit <= 125) {
+            if (len > 125) {
+                m_parse_stage = ParseStage::ERROR;
+                return;
+            }
+        } else if constexpr (frame_limit <= 0xFFFF) {
+            if (len == 127) {
+                m_parse_stage = ParseStage::ERROR;
+                return;
+            }
+            header_len += (len == 126) ? 2 : 0;
+        } else {
+            header_len += (len == 126) ? 2 : ((len == 127) ? 8 : 0);
+        }
+        if (remaining() < header_len)
+            return;
+
+        m_frame.fin = buf[0] & 0x80;
+        m_frame.opcode = static_cast<wsframe::Frame::Opcode>(buf[0] & 0x0F);
+        m_frame.mask = mask;
+        m_frame.payload = {};
+        buf += 2;
+        m_payload_len = len;
+        if constexpr (frame_limit > 125) {
+            if (len == 126) {
+                m_payload_len = (std::uint64_t(buf[0]) << 8) | buf[1];
+                buf += 2;
+            }
+        }
+        if constexpr (frame_limit > 0xFFFF) {
+            if (len == 127) {
+                m_payload_len = 0;
+                for (int i = 0; i < 8; i++) {
+                    m_payload_len = (m_payload_len << 8) | buf[i];
+                }
+                buf += 8;
+            }
+        }
+        if constexpr (frame_limit < std::numeric_limits<std::uint64_t>::max()) {
+            if (m_payload_len > frame_limit) {
+                m_parse_stage = ParseStage::ERROR;
+                return;
+            }
+        }
+        if (mask) {
+            std::memcpy(m_frame.masking_key.data(), buf, 4);
+        }
+        m_mask_offset = 0;
+        m_ptr += header_len;
+
+        if (!check_message_size())
+            return;
+
+        m_streaming = m_payload_len > m_max_buffered_payload;
+        m_first_chunk = true;
+        m_parse_stage =
+            m_streaming ? ParseStage::PAYLOAD_STREAM : ParseStage::PAYLOAD_DATA;
+    }
+
+    bool check_message_size() {
+        switch (m_frame.opcode) {
+        case wsframe::Frame::Opcode::TEXT:
+        case wsframe::Frame::Opcode::BINARY:
+            m_message_size = m_payload_len;
+            break;
+        case wsframe::Frame::Opcode::CONTINUATION:
+            m_message_size += m_payload_len;
+            break;
+        default:
+            return true;
+        }
+        if (m_message_size <= m_max_message_size)
+            return true;
+        m_parse_stage = ParseStage::ERROR;
+        return false;
+    }
+
+    // unmasks the next len bytes where they are
+    void unmask(std::size_t len) {
+        if constexpr (!Unmasking)
+            return;
+        if (!m_frame.mask)
+            return;
+        std::uint8_t* payload = m_frame_buffer.head() + m_ptr;
+        mask_payload(payload, payload, len, m_frame.masking_key.data(),
+                     m_mask_offset);
+        m_mask_offset += len;
+    }
+
+    void check_payload_data() {
+        if ((m_parse_stage != ParseStage::PAYLOAD_DATA) ||
+            (remaining() < m_payload_len))
+            return;
+        unmask(m_payload_len);
+        m_frame.payload =
+            std::string_view((const char*)cursor(), m_payload_len);
+        m_ptr += m_payload_len;
+        m_parse_stage = ParseStage::DONE;
+    }
+
+    void check_payload_stream() {
+        if ((m_parse_stage != ParseStage::PAYLOAD_STREAM) || (remaining() == 0))
+            return;
+        const std::size_t chunk =
+            std::min<std::uint64_t>(remaining(), m_payload_len);
+        unmask(chunk);
+        m_frame.payload = std::string_view((const char*)cursor(), chunk);
+        m_ptr += chunk;
+        m_payload_len -= chunk;
+        m_last_chunk = m_payload_len == 0;
+        m_parse_stage = ParseStage::DONE;
+    }
+
+    bool done() const { return m_parse_stage == ParseStage::DONE; }
+
+    std::optional<wsframe::Frame> parse() {
+        check_header();
+        check_payload_data();
+        check_payload_stream();
+        m_waiting = !done();
+        if (m_waiting)
+            return {};
+        return m_frame;
+    }
+
+    void reset() {
+        if (!m_defer_compaction)
+            compact();
+        m_waiting = false;
+
+        // keep the header around until we have seen all of a streamed frame
+        if (m_streaming && !m_last_chunk) {
+            m_first_chunk = false;
+            m_parse_stage = ParseStage::PAYLOAD_STREAM;
+            return;
+        }
+        m_frame = {};
+        m_payload_len = 0;
+        m_streaming = false;
+        m_last_chunk = false;
+        m_parse_stage = ParseStage::HEADER;
+    }
+
+  public:
+    BasicStreamingFrameParser(Buffer buffer = Buffer())
+        : m_frame_buffer(std::move(buffer)) {}
+
+    void clear() {
+        m_frame_buffer.reset();
+        m_ptr = 0;
+        m_frame = {};
+        m_payload_len = 0;
+        m_mask_offset = 0;
+        m_message_size = 0;
+        m_streaming = false;
+        m_last_chunk = false;
+        m_waiting = false;
+        m_parse_stage = ParseStage::HEADER;
+    }
+
+    void set_defer_compaction(bool defer) { m_defer_compaction = defer; }
+
+    bool defer_compaction() const { return m_defer_compaction; }
+
+    // moves what hasn't been parsed yet to the front of the buffer, which
+    // invalidates every frame returned so far
+    void compact() {
+        if (m_ptr == 0)
+            return;
+        m_frame_buffer.discard_front(m_ptr);
+        m_ptr = 0;
+    }
+
+    // payloads bigger than this are handed out in chunks. Control frames
+    // are at most 125 bytes so they always come back whole.
+    void set_max_buffered_payload(std::uint64_t max_buffered_payload) {
+        m_max_buffered_payload = std::max<std::uint64_t>(max_buffered_payload,
+                                                         125);
+    }
+
+    std::uint64_t max_buffered_payload() const {
+        return m_max_buffered_payload;
+    }
+
+    void set_max_message_size(std::uint64_t max_message_size) {
+        m_max_message_size = max_message_size;
+    }
+
+    std::uint64_t max_message_size() const { return m_max_message_size; }
+
+    // a message went over max_message_size, nothing more will be parsed
+    bool failed() const { return m_parse_stage == ParseStage::ERROR; }
+
+    // gives the buffer's storage back if there is nothing in it
+    bool release_if_idle() {
+        if (done())
+            reset();
+        if (remaining() != 0)
+            return false;
+        m_frame_buffer.reset();
+        m_ptr = 0;
+        return m_frame_buffer.release();
+    }
+
+    // How much to read from the socket next. Once we are holding enough
+    // bytes for the largest frame we would buffer, there is always a frame
+    // or chunk to parse, so we stop reading until that has been handed out.
+    // This keeps the buffer under max_buffered_payload + header + chunk_size.
+    std::size_t read_size(std::size_t chunk_size) const {
+        if constexpr (detail::is_fixed_buffer<Buffer>::value)
+            return std::min(chunk_size, m_frame_buffer.free_space());
+        if (m_max_buffered_payload == std::numeric_limits<std::uint64_t>::max())
+            return chunk_size;
+        return (m_frame_buffer.size() >= m_max_buffered_payload + 14)
+                   ? 0
+                   : chunk_size;
+    }
+
+    std::optional<wsframe::Frame> update(bool new_data) {
+        if (done())
+            reset();
+        if (failed())
+            return {};
+        if ((!new_data) && m_waiting)
+            return {};
+        if (remaining() == 0)
+            return {};
+        return parse();
+    }
+
+    // the last frame returned was a chunk of a bigger frame
+    bool streaming() const { return m_streaming; }
+
+    bool first_chunk() const { return m_first_chunk; }
+
+    bool last_chunk() const { return m_last_chunk; }
+
+    // bytes in the buffer that haven't been parsed yet, i.e. the start of a
+    // frame we don't have all of
+    std::size_t unparsed() const { return remaining(); }
+
+    Buffer& frame_buffer() { return m_frame_buffer; }
+    const Buffer& frame_buffer() const { return m_frame_buffer; }
+};
+
+using StreamingFrameParser = BasicStreamingFrameParser<PooledBuffer>;
+
+} // namespace fastws
+
+#endif // _FASTWS_STREAMING_PARSER_HPP_
@@ -0,0 +1,49 @@
+#ifndef _FASTWS_TCP_INFO_HPP_
+#define _FASTWS_TCP_INFO_HPP_
+
+#include "clock.hpp"
+
+#include <cstdint>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace fastws {
+
+// The kernel's view of a TCP connection at one point in time (TCP_INFO), to
+// tell a slow network from a slow server: the kernel's RTT only covers the
+// network, a ping's RTT covers the server too.
+struct TcpInfo {
+    std::uint64_t sampled_at = 0; // ns, on fastws::clock, 0 if never
+    std::uint32_t rtt_us = 0;     // smoothed RTT
+    std::uint32_t rttvar_us = 0;  // and its mean deviation
+    std::uint32_t retransmits = 0; // segments retransmitted, in all
+    std::uint32_t lost = 0;        // segments currently thought lost
+    std::uint32_t cwnd = 0;        // congestion window, in segments
+    std::uint32_t unacked = 0;     // segments sent but not acked yet
+    std::uint32_t rcv_space = 0;   // receive buffer autotuning, bytes
+
+    bool valid() const { return sampled_at != 0; }
+};
+
+// one getsockopt(), false (leaving out alone) if it failed
+inline bool read_tcp_info(int fd, TcpInfo& out) {
+    tcp_info info = {};
+    socklen_t len = sizeof(info);
+    if ((fd < 0) || (::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0))
+        return false;
+    out.sampled_at = clock::now_ns();
+    out.rtt_us = info.tcpi_rtt;
+    out.rttvar_us = info.tcpi_rttvar;
+    out.retransmits = info.tcpi_total_retrans;
+    out.lost = info.tcpi_lost;
+    out.cwnd = info.tcpi_snd_cwnd;
+    out.unacked = info.tcpi_unacked;
+    out.rcv_space = info.tcpi_rcv_space;
+    return true;
+}
+
+} // namespace fastws
+
+#endif // _FASTWS_TCP_INFO_HPP_
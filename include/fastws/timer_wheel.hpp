@@ -0,0 +1,252 @@
+#ifndef _FASTWS_TIMER_WHEEL_HPP_
+#define _FASTWS_TIMER_WHEEL_HPP_
+
+#include "clock.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace fastws {
+
+// Clock that is read once per loop iteration and then handed out for free.
+class CachedClock {
+  private:
+    std::uint64_t m_now_ns = 0;
+
+  public:
+    CachedClock() { update(); }
+
+    static std::uint64_t read_ns() { return clock::now_ns(); }
+
+    std::uint64_t update() {
+        m_now_ns = read_ns();
+        return m_now_ns;
+    }
+
+    std::uint64_t now_ns() const { return m_now_ns; }
+
+    std::uint64_t now_ms() const { return m_now_ns / 1000000; }
+};
+
+class TimerWheel;
+
+// Intrusive timer, owned by whoever wants the callback. It unlinks itself
+// from the wheel when destroyed, so it is safe to destroy while armed. Not
+// copyable or movable since the wheel points at it.
+class Timer {
+  private:
+    friend class TimerWheel;
+
+    Timer* m_prev = this;
+    Timer* m_next = this;
+    TimerWheel* m_wheel = nullptr;
+    std::uint64_t m_deadline = 0; // ms
+    void (*m_callback)(void*) = nullptr;
+    void* m_ctx = nullptr;
+
+    bool linked() const { return m_next != this; }
+
+    void unlink() {
+        m_prev->m_next = m_next;
+        m_next->m_prev = m_prev;
+        m_prev = this;
+        m_next = this;
+    }
+
+    void link_before(Timer* node) {
+        m_prev = node->m_prev;
+        m_next = node;
+        node->m_prev->m_next = this;
+        node->m_prev = this;
+    }
+
+  public:
+    Timer() {}
+
+    Timer(void (*callback)(void*), void* ctx)
+        : m_callback(callback), m_ctx(ctx) {}
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    ~Timer() { cancel(); }
+
+    void set_callback(void (*callback)(void*), void* ctx) {
+        m_callback = callback;
+        m_ctx = ctx;
+    }
+
+    inline void cancel();
+
+    bool armed() const { return m_wheel != nullptr; }
+
+    // ms, on the wheel's clock
+    std::uint64_t deadline() const { return m_deadline; }
+};
+
+// Hierarchical timing wheel (Varghese & Lauck) with 1 ms ticks shared by a
+// group of connections polled from the same thread. 4 levels of 64 slots
+// cover ~4.6 hours, anything further out sits in the top level and gets
+// cascaded again. Scheduling and cancelling are O(1); poll() reads the clock
+// once and only walks slots for ticks that have actually passed.
+class TimerWheel {
+  private:
+    static constexpr int slot_bits = 6;
+    static constexpr std::uint64_t slots = 1 << slot_bits;
+    static constexpr std::uint64_t slot_mask = slots - 1;
+    static constexpr int levels = 4;
+    static constexpr std::uint64_t max_delta =
+        (std::uint64_t(1) << (slot_bits * levels)) - 1;
+
+    // each slot is a circular list with a sentinel node
+    std::array<std::array<Timer, slots>, levels> m_slots;
+    CachedClock m_clock;
+    std::uint64_t m_current; // last tick processed, ms
+    std::size_t m_count = 0;
+
+    // earliest is the first tick the timer can still go off on, which is
+    // the current tick while it is being cascaded and the next one otherwise
+    void insert(Timer& timer, std::uint64_t earliest) {
+        std::uint64_t deadline = std::max(timer.m_deadline, earliest);
+        std::uint64_t delta = deadline - m_current;
+        if (delta > max_delta) {
+            delta = max_delta;
+            deadline = m_current + max_delta;
+        }
+        int level = 0;
+        while (delta >= (std::uint64_t(1) << (slot_bits * (level + 1))))
+            level++;
+        const std::uint64_t slot =
+            (deadline >> (slot_bits * level)) & slot_mask;
+        timer.link_before(&m_slots[level][slot]);
+    }
+
+    // moves every timer in a slot down to where it belongs now
+    void cascade(int level, std::uint64_t slot) {
+        Timer pending;
+        Timer& head = m_slots[level][slot];
+        while (head.linked()) {
+            Timer* timer = head.m_next;
+            timer->unlink();
+            timer->link_before(&pending);
+        }
+        while (pending.linked()) {
+            Timer* timer = pending.m_next;
+            timer->unlink();
+            insert(*timer, m_current);
+        }
+    }
+
+    void tick() {
+        m_current++;
+        // cascade from the highest level that wrapped this tick down
+        int top = 0;
+        while ((top + 1 < levels) &&
+               ((m_current & ((std::uint64_t(1) << (slot_bits * (top + 1))) -
+                              1)) == 0))
+            top++;
+        for (int level = top; level > 0; level--) {
+            cascade(level, (m_current >> (slot_bits * level)) & slot_mask);
+        }
+
+        // callbacks can schedule/cancel anything (including timers in this
+        // slot), so take the list out of the wheel before firing
+        Timer expired;
+        Timer& head = m_slots[0][m_current & slot_mask];
+        while (head.linked()) {
+            Timer* timer = head.m_next;
+            timer->unlink();
+            timer->link_before(&expired);
+        }
+        while (expired.linked()) {
+            Timer* timer = expired.m_next;
+            timer->unlink();
+            if (timer->m_deadline > m_current) {
+                // was clamped to the top level, not due yet
+                insert(*timer, m_current + 1);
+                continue;
+            }
+            timer->m_wheel = nullptr;
+            m_count--;
+            if (timer->m_callback)
+                timer->m_callback(timer->m_ctx);
+        }
+    }
+
+  public:
+    TimerWheel() : m_current(m_clock.now_ms()) {}
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    ~TimerWheel() {
+        for (auto& level : m_slots) {
+            for (auto& head : level) {
+                while (head.linked()) {
+                    Timer* timer = head.m_next;
+                    timer->unlink();
+                    timer->m_wheel = nullptr;
+                }
+            }
+        }
+    }
+
+    // (re)arms timer to fire at deadline_ms on clock()
+    void schedule(Timer& timer, std::uint64_t deadline_ms) {
+        if (timer.m_wheel)
+            cancel(timer);
+        timer.m_deadline = deadline_ms;
+        timer.m_wheel = this;
+        m_count++;
+        insert(timer, m_current + 1);
+    }
+
+    // (re)arms timer to fire delay after the cached time
+    void schedule_in(Timer& timer, std::chrono::milliseconds delay) {
+        schedule(timer, m_clock.now_ms() + std::max<std::int64_t>(
+                                                delay.count(), 0));
+    }
+
+    void cancel(Timer& timer) {
+        if (!timer.m_wheel)
+            return;
+        timer.unlink();
+        timer.m_wheel = nullptr;
+        m_count--;
+    }
+
+    // Updates the cached clock and fires everything that is due. Call this
+    // once per iteration of the loop polling the clients. Returns how many
+    // ms ticks were processed.
+    std::uint64_t poll() {
+        const std::uint64_t now = m_clock.update() / 1000000;
+        if (now <= m_current)
+            return 0;
+        const std::uint64_t ticks = now - m_current;
+        if (m_count == 0) {
+            m_current = now;
+            return ticks;
+        }
+        while (m_current < now)
+            tick();
+        return ticks;
+    }
+
+    const CachedClock& clock() const { return m_clock; }
+
+    // ms on the cached clock
+    std::uint64_t now_ms() const { return m_clock.now_ms(); }
+
+    std::size_t size() const { return m_count; }
+};
+
+inline void Timer::cancel() {
+    if (m_wheel)
+        m_wheel->cancel(*this);
+}
+
+} // namespace fastws
+
+#endif // _FASTWS_TIMER_WHEEL_HPP_
@@ -0,0 +1,460 @@
+#ifndef _FASTWS_TLS_ENGINE_HPP_
+#define _FASTWS_TLS_ENGINE_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace fastws {
+
+class TLSEngineException : public std::runtime_error {
+  public:
+    explicit TLSEngineException(const std::string& msg)
+        : std::runtime_error(msg) {}
+};
+
+// Client side TLS sessions, kept per "host:port" so reconnects can resume
+// (and, for TLS 1.3 sessions that allow it, send early data). Sessions are
+// taken out when used since servers that accept early data only accept a
+// ticket once, the new connection gets a fresh one. install() has to be
+// called on the SSL_CTX for new sessions to come back here.
+class TLSSessionCache {
+  public:
+    // where the sessions of one connection go
+    struct Target {
+        TLSSessionCache* cache;
+        std::string key;
+    };
+
+  private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, SSL_SESSION*> m_sessions;
+    bool m_enabled = true;
+    bool m_early_data = true;
+
+    static int new_session(SSL* ssl, SSL_SESSION* session) {
+        auto* target = static_cast<Target*>(SSL_get_ex_data(ssl, ex_index()));
+        if ((!target) || (!SSL_SESSION_is_resumable(session)))
+            return 0;
+        return target->cache->store(target->key, session) ? 1 : 0;
+    }
+
+  public:
+    TLSSessionCache() {}
+
+    TLSSessionCache(const TLSSessionCache&) = delete;
+    TLSSessionCache& operator=(const TLSSessionCache&) = delete;
+
+    ~TLSSessionCache() { clear(); }
+
+    // used by SSLSocketWrapper unless told otherwise
+    static TLSSessionCache& global() {
+        static TLSSessionCache cache;
+        return cache;
+    }
+
+    // slot on the SSL that holds its Target
+    static int ex_index() {
+        static const int index =
+            SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    // turns on client session caching for ctx, with new sessions handed to
+    // the cache the engine was given
+    static void install(SSL_CTX* ctx) {
+        SSL_CTX_set_session_cache_mode(
+            ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, &TLSSessionCache::new_session);
+    }
+
+    static std::string key(const std::string& host, long port) {
+        return host + ":" + std::to_string(port);
+    }
+
+    // takes ownership of session, false (and nothing taken) if disabled
+    bool store(const std::string& key, SSL_SESSION* session) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_enabled)
+            return false;
+        auto& slot = m_sessions[key];
+        if (slot)
+            SSL_SESSION_free(slot);
+        slot = session;
+        return true;
+    }
+
+    // the caller owns what comes back (SSL_SESSION_free), nullptr if none
+    SSL_SESSION* take(const std::string& key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_sessions.find(key);
+        if ((!m_enabled) || (it == m_sessions.end()))
+            return nullptr;
+        SSL_SESSION* out = it->second;
+        m_sessions.erase(it);
+        return out;
+    }
+
+    bool contains(const std::string& key) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_sessions.find(key) != m_sessions.end();
+    }
+
+    void remove(const std::string& key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_sessions.find(key);
+        if (it == m_sessions.end())
+            return;
+        SSL_SESSION_free(it->second);
+        m_sessions.erase(it);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& [key, session] : m_sessions) {
+            SSL_SESSION_free(session);
+        }
+        m_sessions.clear();
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_sessions.size();
+    }
+
+    // no resumption at all (clearing what we have)
+    void set_enabled(bool enabled) {
+        if (!enabled)
+            clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_enabled = enabled;
+    }
+
+    bool enabled() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_enabled;
+    }
+
+    // resume, but don't send early data
+    void set_early_data(bool early_data) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_early_data = early_data;
+    }
+
+    bool early_data() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_early_data;
+    }
+};
+
+// TLS client that never touches a socket. OpenSSL is given a BIO pair
+// instead of an fd: ciphertext received by whatever transport is in use is
+// written straight into the pair's buffer (incoming_space() +
+// commit_incoming(), or feed()), and ciphertext to be sent is taken from
+// outgoing() + consume_outgoing(). Plaintext goes in with write() and comes
+// out with read()/read_into(). This lets TLS sit on a plain socket, io_uring
+// or anything else, and lets the caller read ciphertext in big batches
+// rather than one record (or less) per syscall.
+class TLSEngine {
+  private:
+    SSL* m_ssl = nullptr;
+    // our end of the pair, OpenSSL has the other one
+    BIO* m_network = nullptr;
+    // the last read ran out of ciphertext in the middle of a record, so
+    // there is no point trying again until more arrives
+    bool m_starved = false;
+    std::size_t m_buffer_size = 0;
+    // where new sessions go, set by use_session_cache()
+    std::unique_ptr<TLSSessionCache::Target> m_target;
+    bool m_early_data = false;
+
+    static std::string get_ssl_error() {
+        std::string out = "";
+        unsigned long err;
+        while ((err = ERR_get_error())) {
+            char* str = ERR_error_string(err, 0);
+            if (str)
+                out += std::string(str);
+        }
+        return out;
+    }
+
+    // throws for anything other than needing more data (or more room)
+    void check(int ret, const char* what) {
+        switch (SSL_get_error(m_ssl, ret)) {
+        case SSL_ERROR_NONE:
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            return;
+        case SSL_ERROR_ZERO_RETURN:
+            throw TLSEngineException(std::string(what) +
+                                     ": connection closed");
+        default:
+            throw TLSEngineException(std::string(what) + ": " +
+                                     get_ssl_error());
+        }
+    }
+
+    void free() {
+        if (m_ssl)
+            SSL_free(m_ssl);
+        m_target.reset();
+        if (m_network)
+            BIO_free(m_network);
+        m_ssl = nullptr;
+        m_network = nullptr;
+    }
+
+  public:
+    // how much ciphertext can be buffered on the way in, i.e. the biggest
+    // batch a transport can hand over at once
+    static constexpr std::size_t default_incoming_size = 1 << 16;
+    // and on the way out, a couple of full records
+    static constexpr std::size_t default_outgoing_size = 1 << 15;
+
+    TLSEngine() {}
+
+    // host is used for SNI, ctx has to be a client context
+    TLSEngine(SSL_CTX* ctx, const std::string& host,
+              std::size_t incoming_size = default_incoming_size,
+              std::size_t outgoing_size = default_outgoing_size)
+        : m_buffer_size(incoming_size + outgoing_size) {
+        BIO* internal = nullptr;
+        m_ssl = SSL_new(ctx);
+        if ((!m_ssl) || (!BIO_new_bio_pair(&internal, outgoing_size,
+                                           &m_network, incoming_size))) {
+            free();
+            throw TLSEngineException("Failed to create SSL.");
+        }
+        SSL_set_bio(m_ssl, internal, internal);
+        SSL_set_tlsext_host_name(m_ssl, host.c_str());
+        SSL_set_connect_state(m_ssl);
+    }
+
+    TLSEngine(const TLSEngine&) = delete;
+    TLSEngine& operator=(const TLSEngine&) = delete;
+
+    TLSEngine(TLSEngine&& other)
+        : m_ssl(other.m_ssl), m_network(other.m_network),
+          m_starved(other.m_starved), m_buffer_size(other.m_buffer_size),
+          m_target(std::move(other.m_target)),
+          m_early_data(other.m_early_data) {
+        other.m_ssl = nullptr;
+        other.m_network = nullptr;
+    }
+
+    TLSEngine& operator=(TLSEngine&& other) {
+        free();
+        m_ssl = other.m_ssl;
+        m_network = other.m_network;
+        m_starved = other.m_starved;
+        m_buffer_size = other.m_buffer_size;
+        m_target = std::move(other.m_target);
+        m_early_data = other.m_early_data;
+        other.m_ssl = nullptr;
+        other.m_network = nullptr;
+        return *this;
+    }
+
+    ~TLSEngine() { free(); }
+
+    explicit operator bool() const { return m_ssl != nullptr; }
+
+    SSL* ssl() const { return m_ssl; }
+
+    // Takes the handshake as far as it can go with the ciphertext we have.
+    // Returns true once it is done, otherwise flush outgoing(), receive
+    // more and call again.
+    bool handshake() {
+        const int ret = SSL_do_handshake(m_ssl);
+        if (ret == 1)
+            return true;
+        check(ret, "SSL handshake");
+        return false;
+    }
+
+    bool handshake_done() const {
+        return m_ssl && SSL_is_init_finished(m_ssl);
+    }
+
+    // Resumes the session cache has for key, if any, and sends the
+    // sessions the server gives us back to it. Call before the handshake.
+    void use_session_cache(TLSSessionCache& cache, const std::string& key) {
+        m_target.reset(new TLSSessionCache::Target{&cache, key});
+        SSL_set_ex_data(m_ssl, TLSSessionCache::ex_index(), m_target.get());
+        SSL_SESSION* session = cache.take(key);
+        if (!session)
+            return;
+        SSL_set_session(m_ssl, session);
+        m_early_data = cache.early_data() &&
+                       (SSL_SESSION_get_max_early_data(session) > 0);
+        SSL_SESSION_free(session);
+    }
+
+    // how much early data the session we are resuming allows, 0 if none
+    std::size_t max_early_data() const {
+        if (!m_early_data)
+            return 0;
+        return SSL_SESSION_get_max_early_data(SSL_get_session(m_ssl));
+    }
+
+    // Queues data to go out with the ClientHello (TLS 1.3 0-RTT), returns
+    // how much was taken. Only possible before the handshake, and only when
+    // max_early_data() > 0. Whether the server took it is only known once
+    // the handshake is done (early_data_accepted()), if it didn't the data
+    // has to be sent again.
+    std::size_t write_early_data(std::string_view data) {
+        if (data.empty() || (max_early_data() == 0))
+            return 0;
+        std::size_t written = 0;
+        const int ret = SSL_write_early_data(m_ssl, data.data(), data.size(),
+                                             &written);
+        if (ret <= 0)
+            check(ret, "SSL_write_early_data");
+        return written;
+    }
+
+    bool early_data_accepted() const {
+        return m_ssl &&
+               (SSL_get_early_data_status(m_ssl) == SSL_EARLY_DATA_ACCEPTED);
+    }
+
+    // the handshake resumed a session
+    bool resumed() const { return m_ssl && SSL_session_reused(m_ssl); }
+
+    // where to put received ciphertext, may be less than all of the free
+    // space when the buffer wraps around
+    char* incoming_space(std::size_t& len) {
+        char* buf = nullptr;
+        const ossl_ssize_t n = BIO_nwrite0(m_network, &buf);
+        len = n > 0 ? n : 0;
+        return buf;
+    }
+
+    // len bytes were written to incoming_space()
+    void commit_incoming(std::size_t len) {
+        char* buf = nullptr;
+        BIO_nwrite(m_network, &buf, len);
+        m_starved = false;
+    }
+
+    // copies ciphertext in, returns how much fit
+    std::size_t feed(std::string_view ciphertext) {
+        std::size_t done = 0;
+        while (done < ciphertext.size()) {
+            std::size_t len = 0;
+            char* buf = incoming_space(len);
+            if (len == 0)
+                break;
+            len = std::min(len, ciphertext.size() - done);
+            std::memcpy(buf, ciphertext.data() + done, len);
+            commit_incoming(len);
+            done += len;
+        }
+        return done;
+    }
+
+    // ciphertext waiting to go out (the contiguous part of it)
+    std::string_view outgoing() {
+        char* buf = nullptr;
+        const ossl_ssize_t n = BIO_nread0(m_network, &buf);
+        return n > 0 ? std::string_view(buf, n) : std::string_view();
+    }
+
+    // len bytes of outgoing() were sent
+    void consume_outgoing(std::size_t len) {
+        char* buf = nullptr;
+        BIO_nread(m_network, &buf, len);
+    }
+
+    bool has_outgoing() const { return BIO_ctrl_pending(m_network) > 0; }
+
+    // Encrypts as much of plaintext as there is room for, returns how much
+    // that was. Anything short of all of it means outgoing() has to be
+    // flushed first.
+    std::size_t write(std::string_view plaintext) {
+        if (plaintext.empty())
+            return 0;
+        std::size_t written = 0;
+        const int ret = SSL_write_ex(m_ssl, plaintext.data(),
+                                     plaintext.size(), &written);
+        if (ret <= 0)
+            check(ret, "SSL_write");
+        return written;
+    }
+
+    // Decrypts up to len bytes into buf. Like SSL_read_ex on a socket this
+    // doesn't throw, errors and close_notify just mean nothing more comes
+    // out (see closed()).
+    std::size_t read(void* buf, std::size_t len) {
+        if ((len == 0) || m_starved)
+            return 0;
+        std::size_t read = 0;
+        if (SSL_read_ex(m_ssl, buf, len, &read) <= 0)
+            m_starved = true;
+        return read;
+    }
+
+    // Decrypts whole records straight into frame_buffer (anything with the
+    // wsframe::FrameBuffer interface) until max_len bytes have been added or
+    // we run out of ciphertext. Returns how many bytes were added.
+    template <class Buffer>
+    std::size_t read_into(Buffer& frame_buffer, std::size_t max_len) {
+        std::size_t total = 0;
+        frame_buffer.ensure_extra_space(max_len);
+        while (total < max_len) {
+            const std::size_t got =
+                read(frame_buffer.tail(), max_len - total);
+            if (got == 0)
+                break;
+            frame_buffer.claim_space(got);
+            total += got;
+        }
+        return total;
+    }
+
+    // decrypted bytes ready to be read
+    std::size_t pending() const { return m_ssl ? SSL_pending(m_ssl) : 0; }
+
+    // ciphertext received but not decrypted yet
+    std::size_t buffered_ciphertext() const {
+        return m_network ? BIO_ctrl_wpending(m_network) : 0;
+    }
+
+    // whether a read could return something without more ciphertext
+    bool has_pending() const {
+        return (pending() > 0) ||
+               ((!m_starved) && (buffered_ciphertext() > 0));
+    }
+
+    // the peer sent close_notify
+    bool closed() const {
+        return m_ssl && (SSL_get_shutdown(m_ssl) & SSL_RECEIVED_SHUTDOWN);
+    }
+
+    // queues a close_notify, to be flushed from outgoing()
+    void shutdown() {
+        if (m_ssl && SSL_is_init_finished(m_ssl))
+            SSL_shutdown(m_ssl);
+    }
+
+    // memory held by the ciphertext buffers
+    std::size_t buffer_size() const { return m_ssl ? m_buffer_size : 0; }
+
+    const char* cipher() const { return SSL_get_cipher(m_ssl); }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_TLS_ENGINE_HPP_
@@ -0,0 +1,426 @@
+#ifndef _FASTWS_UTF8_HPP_
+#define _FASTWS_UTF8_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define FASTWS_UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+namespace fastws {
+
+namespace utf8 {
+
+// length of a sequence given its lead byte, 0 if it can't start a sequence
+inline std::size_t sequence_length(std::uint8_t lead) {
+    if (lead < 0x80)
+        return 1;
+    if (lead < 0xC2)
+        return 0; // continuation byte or overlong 2 byte lead
+    if (lead < 0xE0)
+        return 2;
+    if (lead < 0xF0)
+        return 3;
+    if (lead < 0xF5)
+        return 4;
+    return 0;
+}
+
+// checks a single complete sequence of sequence_length(buf[0]) bytes
+inline bool valid_sequence(const std::uint8_t* buf, std::size_t len) {
+    switch (len) {
+    case 1:
+        return true;
+    case 2:
+        return (buf[1] & 0xC0) == 0x80;
+    case 3: {
+        if ((buf[1] & 0xC0) != 0x80 || (buf[2] & 0xC0) != 0x80)
+            return false;
+        if (buf[0] == 0xE0 && buf[1] < 0xA0)
+            return false; // overlong
+        if (buf[0] == 0xED && buf[1] > 0x9F)
+            return false; // surrogate
+        return true;
+    }
+    case 4: {
+        if ((buf[1] & 0xC0) != 0x80 || (buf[2] & 0xC0) != 0x80 ||
+            (buf[3] & 0xC0) != 0x80)
+            return false;
+        if (buf[0] == 0xF0 && buf[1] < 0x90)
+            return false; // overlong
+        if (buf[0] == 0xF4 && buf[1] > 0x8F)
+            return false; // > U+10FFFF
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Validates buf[0, len). Returns the number of trailing bytes that form a
+// truncated (but so far valid) sequence, or -1 if the input is invalid.
+inline long validate_scalar(const std::uint8_t* buf, std::size_t len) {
+    std::size_t i = 0;
+    while (i < len) {
+        // ascii fast path, 8 bytes at a time
+        if (i + 8 <= len) {
+            std::uint64_t word;
+            std::memcpy(&word, buf + i, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        const std::size_t seq = sequence_length(buf[i]);
+        if (seq == 0)
+            return -1;
+        if (i + seq > len) {
+            // truncated, check what we have is a valid prefix
+            for (std::size_t j = i + 1; j < len; j++) {
+                if ((buf[j] & 0xC0) != 0x80)
+                    return -1;
+            }
+            if (len - i > 1) {
+                if (buf[i] == 0xE0 && buf[i + 1] < 0xA0)
+                    return -1;
+                if (buf[i] == 0xED && buf[i + 1] > 0x9F)
+                    return -1;
+                if (buf[i] == 0xF0 && buf[i + 1] < 0x90)
+                    return -1;
+                if (buf[i] == 0xF4 && buf[i + 1] > 0x8F)
+                    return -1;
+            }
+            return static_cast<long>(len - i);
+        }
+        if (!valid_sequence(buf + i, seq))
+            return -1;
+        i += seq;
+    }
+    return 0;
+}
+
+#ifdef FASTWS_UTF8_X86
+
+// Vectorized validation using the lookup algorithm from Keiser & Lemire,
+// "Validating UTF-8 In Less Than One Instruction Per Byte" (2021). Each byte
+// is classified by looking up (high nibble of previous byte, low nibble of
+// previous byte, high nibble of this byte) in three 16 entry tables; a
+// non-zero AND of the three lookups means an error. 3 and 4 byte sequences
+// additionally need their 2nd/3rd continuation bytes checked.
+namespace detail {
+
+constexpr std::uint8_t TOO_SHORT = 1 << 0;
+constexpr std::uint8_t TOO_LONG = 1 << 1;
+constexpr std::uint8_t OVERLONG_3 = 1 << 2;
+constexpr std::uint8_t TOO_LARGE = 1 << 3;
+constexpr std::uint8_t SURROGATE = 1 << 4;
+constexpr std::uint8_t OVERLONG_2 = 1 << 5;
+constexpr std::uint8_t TOO_LARGE_1000 = 1 << 6;
+constexpr std::uint8_t OVERLONG_4 = 1 << 6;
+constexpr std::uint8_t TWO_CONTS = 1 << 7;
+constexpr std::uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// clang-format off
+alignas(16) constexpr std::uint8_t byte_1_high[16] = {
+    // 0_______ ________ <ascii in byte 1>
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    // 10______ ________ <continuation in byte 1>
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    // 1100____ ________ <two byte lead in byte 1>
+    TOO_SHORT | OVERLONG_2,
+    // 1101____ ________ <two byte lead in byte 1>
+    TOO_SHORT,
+    // 1110____ ________ <three byte lead in byte 1>
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    // 1111____ ________ <four+ byte lead in byte 1>
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};
+
+alignas(16) constexpr std::uint8_t byte_1_low[16] = {
+    // ____0000 ________
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    // ____0001 ________
+    CARRY | OVERLONG_2,
+    // ____001_ ________
+    CARRY, CARRY,
+    // ____0100 ________
+    CARRY | TOO_LARGE,
+    // ____0101 ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    // ____011_ ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    // ____1___ ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    // ____1101 ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+alignas(16) constexpr std::uint8_t byte_2_high[16] = {
+    // ________ 0_______ <ascii in byte 2>
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    // ________ 1000____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+        OVERLONG_4,
+    // ________ 1001____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    // ________ 101_____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    // ________ 11______
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT};
+// clang-format on
+
+// returns how many bytes at the front of buf[0, len) were checked; the
+// caller validates the rest (which starts on a sequence boundary) with the
+// scalar path
+__attribute__((target("sse4.1"))) inline std::size_t
+validate_sse(const std::uint8_t* buf, std::size_t len, bool& error) {
+    const __m128i t1h = _mm_load_si128((const __m128i*)byte_1_high);
+    const __m128i t1l = _mm_load_si128((const __m128i*)byte_1_low);
+    const __m128i t2h = _mm_load_si128((const __m128i*)byte_2_high);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i max_incomplete =
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                      (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+
+    __m128i err = _mm_setzero_si128();
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i input = _mm_loadu_si128((const __m128i*)(buf + i));
+        if (_mm_movemask_epi8(input) == 0) {
+            err = _mm_or_si128(err, prev_incomplete);
+            prev_incomplete = _mm_setzero_si128();
+            prev_input = input;
+            continue;
+        }
+        const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+        const __m128i b1h = _mm_shuffle_epi8(
+            t1h, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+        const __m128i b1l = _mm_shuffle_epi8(t1l, _mm_and_si128(prev1, nibble));
+        const __m128i b2h = _mm_shuffle_epi8(
+            t2h, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+        const __m128i sc = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+
+        const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+        const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+        const __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8(0x60));
+        const __m128i is_fourth =
+            _mm_subs_epu8(prev3, _mm_set1_epi8((char)0x70));
+        const __m128i must23 =
+            _mm_and_si128(_mm_or_si128(is_third, is_fourth),
+                          _mm_set1_epi8((char)0x80));
+        err = _mm_or_si128(err, _mm_xor_si128(must23, sc));
+
+        prev_incomplete = _mm_subs_epu8(input, max_incomplete);
+        prev_input = input;
+    }
+    error = !_mm_testz_si128(err, err);
+    return i;
+}
+
+__attribute__((target("avx2"))) inline std::size_t
+validate_avx2(const std::uint8_t* buf, std::size_t len, bool& error) {
+    const __m256i t1h = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i*)byte_1_high));
+    const __m256i t1l = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i*)byte_1_low));
+    const __m256i t2h = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i*)byte_2_high));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i max_incomplete = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+        (char)(0xE0 - 1), (char)(0xC0 - 1));
+
+    __m256i err = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i input = _mm256_loadu_si256((const __m256i*)(buf + i));
+        if (_mm256_movemask_epi8(input) == 0) {
+            err = _mm256_or_si256(err, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+            prev_input = input;
+            continue;
+        }
+        // previous 32 bytes shifted in across the 128 bit lanes
+        const __m256i shifted =
+            _mm256_permute2x128_si256(prev_input, input, 0x21);
+        const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        const __m256i b1h = _mm256_shuffle_epi8(
+            t1h, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+        const __m256i b1l =
+            _mm256_shuffle_epi8(t1l, _mm256_and_si256(prev1, nibble));
+        const __m256i b2h = _mm256_shuffle_epi8(
+            t2h, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+        const __m256i sc = _mm256_and_si256(_mm256_and_si256(b1h, b1l), b2h);
+
+        const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+        const __m256i is_third =
+            _mm256_subs_epu8(prev2, _mm256_set1_epi8(0x60));
+        const __m256i is_fourth =
+            _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)0x70));
+        const __m256i must23 =
+            _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                             _mm256_set1_epi8((char)0x80));
+        err = _mm256_or_si256(err, _mm256_xor_si256(must23, sc));
+
+        prev_incomplete = _mm256_subs_epu8(input, max_incomplete);
+        prev_input = input;
+    }
+    error = !_mm256_testz_si256(err, err);
+    return i;
+}
+
+} // namespace detail
+
+#endif // FASTWS_UTF8_X86
+
+enum class Implementation { SCALAR, SSE4, AVX2 };
+
+inline const char* implementation_to_string(Implementation impl) {
+    switch (impl) {
+    case Implementation::SSE4:
+        return "sse4";
+    case Implementation::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+// best implementation supported by the cpu we are running on
+inline Implementation detect_implementation() {
+#ifdef FASTWS_UTF8_X86
+    static const Implementation impl = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Implementation::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Implementation::SSE4;
+        return Implementation::SCALAR;
+    }();
+    return impl;
+#else
+    return Implementation::SCALAR;
+#endif
+}
+
+// Same contract as validate_scalar, i.e. returns the length of a truncated
+// trailing sequence, or -1 on invalid input.
+inline long validate(const std::uint8_t* buf, std::size_t len,
+                     Implementation impl = detect_implementation()) {
+#ifdef FASTWS_UTF8_X86
+    if (impl != Implementation::SCALAR && len >= 16) {
+        bool error = false;
+        const std::size_t checked = impl == Implementation::AVX2
+                                        ? detail::validate_avx2(buf, len, error)
+                                        : detail::validate_sse(buf, len, error);
+        if (error)
+            return -1;
+        // The vector loop checks every byte against the bytes before it, so
+        // only a sequence that starts in the last 3 checked bytes can still
+        // be missing continuation bytes. Restart the scalar check from the
+        // last lead byte in that window.
+        std::size_t restart = checked;
+        for (std::size_t back = 1; back <= 3 && back <= checked; back++) {
+            if ((buf[checked - back] & 0xC0) != 0x80) {
+                restart = checked - back;
+                break;
+            }
+        }
+        return validate_scalar(buf + restart, len - restart);
+    }
+#endif
+    return validate_scalar(buf, len);
+}
+
+inline bool is_valid(std::string_view str,
+                     Implementation impl = detect_implementation()) {
+    return validate((const std::uint8_t*)str.data(), str.size(), impl) == 0;
+}
+
+} // namespace utf8
+
+// Incremental validator for fragmented messages. Up to 3 bytes of a
+// sequence split across frames are carried over to the next update().
+class Utf8Validator {
+  private:
+    utf8::Implementation m_impl;
+    std::uint8_t m_carry[4];
+    std::size_t m_carry_len = 0;
+    bool m_valid = true;
+
+  public:
+    Utf8Validator(utf8::Implementation impl = utf8::detect_implementation())
+        : m_impl(impl) {}
+
+    void reset() {
+        m_carry_len = 0;
+        m_valid = true;
+    }
+
+    // feed the next piece of the message, returns false once the message is
+    // known to be invalid
+    bool update(std::string_view data) {
+        if (!m_valid)
+            return false;
+        const auto* buf = (const std::uint8_t*)data.data();
+        std::size_t len = data.size();
+
+        // first finish off any sequence left over from the last fragment
+        if (m_carry_len > 0) {
+            const std::size_t seq = utf8::sequence_length(m_carry[0]);
+            const std::size_t take = std::min(seq - m_carry_len, len);
+            std::memcpy(m_carry + m_carry_len, buf, take);
+            m_carry_len += take;
+            buf += take;
+            len -= take;
+            if (m_carry_len < seq) {
+                m_valid =
+                    utf8::validate_scalar(m_carry, m_carry_len) >= 0;
+                return m_valid;
+            }
+            m_carry_len = 0;
+            if (!utf8::valid_sequence(m_carry, seq)) {
+                m_valid = false;
+                return false;
+            }
+        }
+
+        const long truncated = utf8::validate(buf, len, m_impl);
+        if (truncated < 0) {
+            m_valid = false;
+            return false;
+        }
+        std::memcpy(m_carry, buf + len - truncated, truncated);
+        m_carry_len = truncated;
+        return true;
+    }
+
+    // call with the final fragment, also fails on a truncated sequence
+    bool finish(std::string_view data = {}) {
+        bool out = update(data) && (m_carry_len == 0);
+        reset();
+        return out;
+    }
+};
+
+} // namespace fastws
+
+#endif // _FASTWS_UTF8_HPP_
@@ -0,0 +1,118 @@
+#include <fastws/fastws.hpp>
+
+#include "test_util.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+// Once a connection is warmed up, sending and receiving messages (and pings)
+// shouldn't touch the heap. Allocations are counted per thread, so the
+// server's don't count.
+
+static thread_local std::uint64_t allocations = 0;
+
+void* operator new(std::size_t size) {
+    allocations++;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+// out of line, or gcc pairs free() up with the operator new it inlined
+__attribute__((noinline)) static void release(void* ptr) { std::free(ptr); }
+
+void operator delete(void* ptr) noexcept { release(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { release(ptr); }
+
+struct ArenaFeatures : fastws::DefaultFeatures {
+    using allocator = fastws::MonotonicArena;
+};
+
+struct BoundedFeatures : fastws::DefaultFeatures {
+    static constexpr std::uint64_t max_payload = 4096;
+};
+
+template <class Features> struct ClientHandler {
+    using Client = fastws::NoTLSClient<ClientHandler, Features>;
+    std::size_t received = 0;
+    std::size_t bytes = 0;
+    void on_text(Client& client, wsframe::Frame frame) {
+        received++;
+        bytes += frame.payload.size();
+    }
+    void on_binary(Client& client, wsframe::Frame frame) {
+        received++;
+        bytes += frame.payload.size();
+    }
+};
+
+// echoes count messages of every size in sizes, returns the allocations
+template <class Handler>
+static std::uint64_t exchange(typename Handler::Client& client,
+                              Handler& handler, int count) {
+    static const std::size_t sizes[] = {10, 200, 3000};
+    static const std::string payload(4096, 'x');
+    const std::uint64_t before = allocations;
+    for (int i = 0; i < count; i++) {
+        for (std::size_t size : sizes) {
+            const std::size_t expected = handler.received + 1;
+            client.send_binary(std::string_view(payload).substr(0, size));
+            const auto start = fastws::clock::now_ns();
+            while ((handler.received < expected) &&
+                   (fastws::clock::now_ns() - start < 2000000000ull)) {
+                client.drain();
+            }
+        }
+    }
+    return allocations - before;
+}
+
+template <class Features> void test_steady_state(long port) {
+    using Handler = ClientHandler<Features>;
+    Handler handler;
+    typename Handler::Client client(handler, "127.0.0.1", "/", port);
+    // pings go out every ms, their path has to be allocation free too
+    if constexpr (Features::pings) {
+        client.set_ping_interval(std::chrono::milliseconds(1),
+                                 std::chrono::milliseconds(1000));
+    }
+    exchange(client, handler, 100);
+    const std::uint64_t count = exchange(client, handler, 2000);
+    CHECK(handler.received == 3 * 2100);
+    CHECK(count == 0);
+    client.close(1);
+    while (!client.closed())
+        client.drain();
+}
+
+void test_arena() {
+    fastws::MonotonicArena arena(4096);
+    std::size_t a_size = 0, b_size = 0, c_size = 0;
+    auto* a = arena.acquire(100, a_size);
+    auto* b = arena.acquire(1000, b_size);
+    CHECK((a_size >= 100) && (b_size >= 1000));
+    CHECK(b >= a + a_size);
+    // the top slab is rolled back and handed out again
+    arena.release(b, b_size);
+    CHECK(arena.acquire(1000, c_size) == b);
+    // a slab bigger than a block gets a block of its own
+    std::size_t big_size = 0;
+    auto* big = arena.acquire(10000, big_size);
+    CHECK(big_size >= 10000);
+    CHECK(arena.bytes_reserved() >= 4096 + 10000);
+    big[big_size - 1] = 1;
+    arena.reset();
+    CHECK(arena.bytes_reserved() < 4096 + 10000);
+}
+
+int main() {
+    test::EchoServer server;
+    return test::run_tests(
+        [&] { test_steady_state<fastws::DefaultFeatures>(server.port()); },
+        [&] { test_steady_state<ArenaFeatures>(server.port()); },
+        [&] { test_steady_state<BoundedFeatures>(server.port()); },
+        test_arena);
+}
@@ -0,0 +1,200 @@
+#include <fastws/fastws.hpp>
+
+#include "test_util.hpp"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Client protocol handling, against a server that sends frames the echo
+// server wouldn't.
+
+// answers text commands with hand made frames
+struct ScriptHandler {
+    using Server = fastws::WSServer<ScriptHandler>;
+    fastws::FrameFactory factory;
+    void on_open(Server& server, Server::Connection& conn) {}
+    void on_close(Server& server, Server::Connection& conn) {}
+    void on_text(Server& server, Server::Connection& conn,
+                 wsframe::Frame frame) {
+        // "€" split across the fragments, with a ping in between
+        if (frame.payload == "fragments") {
+            conn.send_frame(factory.text(false, false, "ab\xe2\x82"));
+            conn.send_frame(factory.ping(false, "hi"));
+            conn.send_frame(factory.construct(
+                true, wsframe::Frame::Opcode::CONTINUATION, false, "\xac"));
+        } else if (frame.payload.substr(0, 4) == "big:") {
+            const auto size = std::stoul(std::string(frame.payload.substr(4)));
+            conn.send_text(std::string(size, 'x'));
+        } else if (frame.payload.substr(0, 6) == "burst:") {
+            const auto count =
+                std::stoul(std::string(frame.payload.substr(6)));
+            for (std::size_t i = 0; i < count; i++)
+                conn.send_text(std::to_string(i));
+        }
+    }
+    void on_binary(Server& server, Server::Connection& conn,
+                   wsframe::Frame frame) {}
+    void on_continuation(Server& server, Server::Connection& conn,
+                         wsframe::Frame frame) {}
+};
+
+struct ClientHandler {
+    using Client = fastws::NoTLSClient<ClientHandler>;
+    std::string message;
+    bool complete = false;
+    int closes = 0;
+    void on_close(Client& client, bool success) { closes++; }
+    void on_text(Client& client, wsframe::Frame frame) {
+        message = frame.payload;
+        complete = frame.fin;
+    }
+    void on_continuation(Client& client, wsframe::Frame frame) {
+        message += frame.payload;
+        complete = frame.fin;
+    }
+};
+
+static void poll_until_complete(ClientHandler::Client& client,
+                                ClientHandler& handler) {
+    const auto start = fastws::clock::now_ns();
+    while (!handler.complete && !client.closed() &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        client.drain();
+    }
+}
+
+void test_ping_between_fragments() {
+    test::ServerThread<ScriptHandler> server;
+    ClientHandler handler;
+    ClientHandler::Client client(handler, "127.0.0.1", "/", server.port());
+    client.validate_utf8();
+    client.send_text("fragments");
+    poll_until_complete(client, handler);
+    CHECK(handler.complete);
+    CHECK(handler.message == "ab\xe2\x82\xac");
+    CHECK(client.status() == fastws::ConnectionStatus::HEALTHY);
+    CHECK(handler.closes == 0);
+}
+
+template <class Features> struct CloseCounter {
+    using Client = fastws::NoTLSClient<CloseCounter, Features>;
+    int closes = 0;
+    void on_close(Client& client, bool success) { closes++; }
+};
+
+struct BoundedFeatures : fastws::DefaultFeatures {
+    static constexpr std::uint64_t max_payload = 125;
+};
+
+// a message that is too big closes the connection once, however many times
+// it is polled afterwards
+template <class Features> void test_too_big_closes_once(std::size_t size) {
+    test::ServerThread<ScriptHandler> server;
+    CloseCounter<Features> handler;
+    typename CloseCounter<Features>::Client client(handler, "127.0.0.1", "/",
+                                                   server.port());
+    fastws::BufferPolicy policy;
+    policy.max_message_size = 10;
+    client.set_buffer_policy(policy);
+    client.send_text("big:" + std::to_string(size));
+    const auto start = fastws::clock::now_ns();
+    while (!client.closed() &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        client.drain();
+    }
+    for (int i = 0; i < 200; i++) {
+        client.poll();
+    }
+    CHECK(client.status() == fastws::ConnectionStatus::MESSAGE_TOO_BIG);
+    CHECK(handler.closes == 1);
+    CHECK(client.stats().frames_out[8].load() == 1);
+}
+
+struct UncountedFeatures : fastws::DefaultFeatures {
+    static constexpr bool instrumentation = false;
+};
+
+// ping RTTs don't depend on instrumentation, only the counters do
+void test_rtt_without_instrumentation() {
+    test::EchoServer server;
+    CloseCounter<UncountedFeatures> handler;
+    CloseCounter<UncountedFeatures>::Client client(handler, "127.0.0.1", "/",
+                                                   server.port());
+    client.set_ping_interval(std::chrono::milliseconds(1),
+                             std::chrono::milliseconds(1000));
+    const auto start = fastws::clock::now_ns();
+    while ((client.rtt_stats().count() < 3) &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        client.drain();
+    }
+    CHECK(client.rtt_stats().count() >= 3);
+    CHECK(client.last_rtt() > 0);
+    CHECK(handler.closes == 0);
+}
+
+// a server that stops answering is reported through on_close, once
+void test_ping_timeout() {
+    test::EchoServer server;
+    CloseCounter<fastws::DefaultFeatures> handler;
+    CloseCounter<fastws::DefaultFeatures>::Client client(
+        handler, "127.0.0.1", "/", server.port());
+    server.stop();
+    client.set_ping_interval(std::chrono::milliseconds(1),
+                             std::chrono::milliseconds(20));
+    const auto start = fastws::clock::now_ns();
+    while (!client.closed() &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        client.poll();
+    }
+    for (int i = 0; i < 200; i++) {
+        client.poll();
+    }
+    CHECK(client.status() == fastws::ConnectionStatus::PING_TIMED_OUT);
+    CHECK(handler.closes == 1);
+}
+
+struct BatchHandler {
+    using Client = fastws::NoTLSClient<BatchHandler>;
+    std::vector<std::size_t> batches;
+    std::vector<std::string> messages;
+    void on_batch(Client& client, fastws::FrameBatch frames) {
+        batches.push_back(frames.size());
+        for (const auto& frame : frames)
+            messages.emplace_back(frame.payload);
+    }
+};
+
+// a burst that is already waiting is handed over in batches under poll()
+// too, not one frame at a time
+void test_poll_batches() {
+    test::ServerThread<ScriptHandler> server;
+    BatchHandler handler;
+    BatchHandler::Client client(handler, "127.0.0.1", "/", server.port());
+    client.send_text("burst:200");
+    // let all of it arrive before the first read
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const auto start = fastws::clock::now_ns();
+    while ((handler.messages.size() < 200) &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        client.poll();
+    }
+    CHECK(handler.messages.size() == 200);
+    bool in_order = true;
+    for (std::size_t i = 0; i < handler.messages.size(); i++)
+        in_order = in_order && (handler.messages[i] == std::to_string(i));
+    CHECK(in_order);
+    CHECK(handler.batches.size() < 20);
+    CHECK(*std::max_element(handler.batches.begin(), handler.batches.end()) >
+          1);
+}
+
+int main() {
+    return test::run_tests(
+        test_ping_between_fragments,
+        [] { test_too_big_closes_once<fastws::DefaultFeatures>(20); },
+        [] { test_too_big_closes_once<BoundedFeatures>(200); },
+        test_rtt_without_instrumentation, test_ping_timeout,
+        test_poll_batches);
+}
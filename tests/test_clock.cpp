@@ -0,0 +1,70 @@
+#include <fastws/clock.hpp>
+
+#include "test_util.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// now_ns() never goes backwards, on any thread, while the TSC rate is being
+// re-fit under it, and keeps up with CLOCK_MONOTONIC_RAW.
+
+void test_monotonic_across_resyncs() {
+    // as if the first calibration had come out 1% fast, so the next resync
+    // lowers the rate a lot
+    if (fastws::clock::uses_tsc()) {
+        auto& mult = fastws::clock::detail::state().mult;
+        mult.store(mult.load() + mult.load() / 100);
+        const std::uint64_t start = fastws::clock::raw_ns();
+        while (fastws::clock::raw_ns() - start < 20000000) {
+        }
+    }
+
+    const int readers = 3;
+    std::atomic<bool> stop{false};
+    std::atomic<int> backwards{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&] {
+            std::uint64_t last = fastws::clock::now_ns();
+            while (!stop) {
+                const std::uint64_t now = fastws::clock::now_ns();
+                if (now < last)
+                    backwards++;
+                last = now;
+            }
+        });
+    }
+
+    std::uint64_t last = fastws::clock::now_ns();
+    for (int i = 0; i < 200000; i++) {
+        if (i % 16 == 0)
+            fastws::clock::resync();
+        const std::uint64_t now = fastws::clock::now_ns();
+        if (now < last)
+            backwards++;
+        last = now;
+    }
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+    CHECK(backwards == 0);
+}
+
+void test_follows_raw_clock() {
+    const std::uint64_t raw_start = fastws::clock::raw_ns();
+    const std::uint64_t start = fastws::clock::now_ns();
+    while (fastws::clock::raw_ns() - raw_start < 50000000) {
+        fastws::clock::resync();
+    }
+    const std::uint64_t raw = fastws::clock::raw_ns() - raw_start;
+    const std::uint64_t elapsed = fastws::clock::now_ns() - start;
+    // within 1%, and then some for the reads themselves
+    CHECK(elapsed > raw - raw / 100 - 100000);
+    CHECK(elapsed < raw + raw / 100 + 100000);
+}
+
+int main() {
+    return test::run_tests(test_monotonic_across_resyncs,
+                           test_follows_raw_clock);
+}
@@ -0,0 +1,116 @@
+#include <fastws/fastws.hpp>
+
+#include "test_util.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Payloads retained from a slab receive buffer have to survive the buffer
+// being compacted, grown and refilled, and their slabs have to go back to the
+// pool once the last one is dropped.
+
+static std::string make_payload(std::size_t size, int seed) {
+    std::string out(size, 'a');
+    for (std::size_t i = 0; i < size; i++) {
+        out[i] = (char)('a' + (i + seed) % 26);
+    }
+    return out;
+}
+
+void test_parser_retains() {
+    fastws::SlabPool pool(4096);
+    fastws::FrameFactory factory;
+    std::vector<std::string> sent;
+    std::vector<fastws::Payload> kept;
+    {
+        fastws::BasicStreamingFrameParser<fastws::SlabBuffer> parser{
+            fastws::SlabBuffer(&pool)};
+        parser.set_defer_compaction(true);
+        // sizes around the slab size, so some frames need a bigger slab
+        for (int round = 0; round < 50; round++) {
+            for (std::size_t size : {10, 300, 2000, 5000}) {
+                sent.push_back(make_payload(size, round));
+                parser.frame_buffer().push_back(
+                    factory.binary(true, false, sent.back()));
+            }
+            for (auto f = parser.update(true); f.has_value();
+                 f = parser.update(false)) {
+                kept.push_back(parser.frame_buffer().retain(f->payload));
+            }
+            parser.compact();
+        }
+        CHECK(kept.size() == sent.size());
+        bool same = true;
+        for (std::size_t i = 0; i < kept.size(); i++) {
+            same &= kept[i].view() == sent[i];
+        }
+        CHECK(same);
+
+        // copies share the bytes
+        fastws::Payload copy = kept.front();
+        CHECK(copy.data() == kept.front().data());
+
+        // a view from somewhere else is copied
+        const std::string other = "not in the buffer";
+        fastws::Payload copied = parser.frame_buffer().retain(other);
+        CHECK((copied.view() == other) && (copied.data() != other.data()));
+    }
+    // dropped on another thread, the slabs go back to the pool
+    std::thread([&] { kept.clear(); }).join();
+    CHECK(pool.bytes_cached() > 0);
+}
+
+struct RetainFeatures : fastws::DefaultFeatures {
+    static constexpr bool retainable_payloads = true;
+};
+
+struct RetainHandler {
+    using Client = fastws::NoTLSClient<RetainHandler, RetainFeatures>;
+    std::vector<fastws::Payload> received;
+    void on_binary(Client& client, wsframe::Frame frame) {
+        received.push_back(client.retain(frame.payload));
+    }
+};
+
+void test_client_retains(long port) {
+    fastws::SlabPool pool;
+    RetainHandler handler;
+    std::vector<std::string> sent;
+    {
+        RetainHandler::Client client(handler, "127.0.0.1", "/", port);
+        client.use_slab_pool(pool);
+        // sent in bursts, so reads hold several frames and partial ones
+        for (int round = 0; round < 20; round++) {
+            for (std::size_t size : {10, 200, 3000, 70000}) {
+                sent.push_back(make_payload(size, round));
+                client.send_binary(sent.back());
+            }
+        }
+        const auto start = fastws::clock::now_ns();
+        while ((handler.received.size() < sent.size()) &&
+               (fastws::clock::now_ns() - start < 2000000000ull)) {
+            client.drain();
+        }
+        client.close(1);
+        while (!client.closed())
+            client.drain();
+    }
+    // the payloads outlive the client
+    CHECK(handler.received.size() == sent.size());
+    bool same = true;
+    for (std::size_t i = 0; i < handler.received.size(); i++) {
+        same &= handler.received[i].view() == sent[i];
+    }
+    CHECK(same);
+    handler.received.clear();
+    CHECK(pool.bytes_cached() > 0);
+}
+
+int main() {
+    test::EchoServer server;
+    return test::run_tests(test_parser_retains,
+                           [&] { test_client_retains(server.port()); });
+}
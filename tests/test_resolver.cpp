@@ -0,0 +1,288 @@
+#include <fastws/resolver.hpp>
+#include <fastws/socket_wrapper.hpp>
+
+#include "test_util.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// stands in for DNS, names are looked up in a table
+struct StubResolver {
+    std::map<std::string, std::vector<std::string>> table;
+    std::atomic<int> lookups{0};
+    std::chrono::milliseconds delay{0};
+
+    fastws::AddressList operator()(const std::string& host, long port) {
+        lookups++;
+        std::this_thread::sleep_for(delay);
+        auto it = table.find(host);
+        if (it == table.end())
+            throw fastws::ResolverException("stub: unknown host " + host);
+        fastws::AddressList out;
+        for (const auto& ip : it->second) {
+            out.push_back(fastws::ResolvedAddress::from_numeric(ip, port));
+        }
+        return out;
+    }
+};
+
+// listening socket on an ephemeral port of ip, connects complete through
+// the backlog without needing an accept()
+struct Listener {
+    int fd = -1;
+    long port = 0;
+
+    Listener(const std::string& ip) {
+        auto addr = fastws::ResolvedAddress::from_numeric(ip, 0);
+        fd = ::socket(addr.family(), SOCK_STREAM, 0);
+        if ((fd < 0) || (::bind(fd, addr.get(), addr.len) != 0) ||
+            (::listen(fd, 16) != 0)) {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+            return;
+        }
+        socklen_t len = addr.len;
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr.addr), &len);
+        if (addr.family() == AF_INET6) {
+            port = ntohs(
+                reinterpret_cast<sockaddr_in6*>(&addr.addr)->sin6_port);
+        } else {
+            port = ntohs(reinterpret_cast<sockaddr_in*>(&addr.addr)->sin_port);
+        }
+    }
+
+    ~Listener() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+};
+
+template <class F> static bool eventually(F f) {
+    for (int i = 0; i < 1000; i++) {
+        if (f())
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+void test_cache() {
+    StubResolver stub;
+    stub.table["feed.test"] = {"127.0.0.1"};
+    fastws::Resolver resolver(std::chrono::seconds(60), std::ref(stub));
+
+    // cold: nothing yet, but a lookup has started
+    CHECK(resolver.try_get("feed.test", 443) == nullptr);
+    CHECK(eventually([&] { return resolver.cached("feed.test", 443); }));
+    CHECK(stub.lookups == 1);
+
+    // warm: no more lookups
+    auto addrs = resolver.resolve("feed.test", 443);
+    CHECK(addrs->size() == 1);
+    CHECK((*addrs)[0].to_string() == "127.0.0.1");
+    CHECK(resolver.try_get("feed.test", 443) == addrs);
+    CHECK(stub.lookups == 1);
+
+    // different port is a different entry
+    resolver.resolve("feed.test", 80);
+    CHECK(stub.lookups == 2);
+
+    // numeric hosts never hit the lookup
+    CHECK(resolver.resolve("::1", 443)->front().family() == AF_INET6);
+    CHECK(stub.lookups == 2);
+}
+
+void test_ttl() {
+    StubResolver stub;
+    stub.table["feed.test"] = {"127.0.0.1"};
+    fastws::Resolver resolver(std::chrono::milliseconds(20), std::ref(stub));
+
+    auto first = resolver.resolve("feed.test", 443);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK(!resolver.cached("feed.test", 443));
+
+    // expired entries are still handed out while being refreshed
+    stub.table["feed.test"] = {"127.0.0.2"};
+    CHECK(resolver.try_get("feed.test", 443) == first);
+    CHECK(eventually([&] { return resolver.cached("feed.test", 443); }));
+    CHECK(stub.lookups == 2);
+    CHECK(resolver.try_get("feed.test", 443)->front().to_string() ==
+          "127.0.0.2");
+
+    // a failed refresh keeps the old result
+    stub.table.clear();
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    resolver.try_get("feed.test", 443);
+    CHECK(eventually([&] { return stub.lookups == 3; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK(resolver.resolve("feed.test", 443)->front().to_string() ==
+          "127.0.0.2");
+}
+
+void test_failure() {
+    StubResolver stub;
+    fastws::Resolver resolver(std::chrono::seconds(60), std::ref(stub),
+                              std::chrono::seconds(60));
+    bool threw = false;
+    try {
+        resolver.resolve("missing.test", 443);
+    } catch (const fastws::ResolverException&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // the failure is cached too
+    threw = false;
+    try {
+        resolver.resolve("missing.test", 443);
+    } catch (const fastws::ResolverException&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(stub.lookups == 1);
+}
+
+void test_slow_lookup() {
+    StubResolver stub;
+    stub.table["slow.test"] = {"127.0.0.1"};
+    stub.delay = std::chrono::milliseconds(200);
+    fastws::Resolver resolver(std::chrono::seconds(60), std::ref(stub));
+
+    // the calling thread never waits on the lookup
+    auto start = std::chrono::steady_clock::now();
+    CHECK(resolver.try_get("slow.test", 443) == nullptr);
+    resolver.prefetch("slow.test", 443);
+    CHECK(std::chrono::steady_clock::now() - start <
+          std::chrono::milliseconds(50));
+
+    // unless it asks to
+    bool threw = false;
+    try {
+        resolver.resolve("slow.test", 443, std::chrono::milliseconds(10));
+    } catch (const fastws::ResolverException&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(resolver.resolve("slow.test", 443) != nullptr);
+    CHECK(stub.lookups == 1);
+}
+
+void test_connect(const std::string& ip) {
+    Listener listener(ip);
+    if (listener.fd < 0) {
+        std::cout << "skipping connect to " << ip << std::endl;
+        return;
+    }
+    StubResolver stub;
+    stub.table["local.test"] = {ip};
+    fastws::Resolver resolver(std::chrono::seconds(60), std::ref(stub));
+
+    fastws::SocketWrapper<> first("local.test", listener.port, resolver);
+    fastws::SocketWrapper<> second("local.test", listener.port, resolver);
+    CHECK(stub.lookups == 1);
+
+    // straight from a cached address
+    auto addrs = resolver.try_get("local.test", listener.port);
+    CHECK(addrs != nullptr);
+    fastws::SocketWrapper<> third("local.test", listener.port, *addrs);
+    CHECK(stub.lookups == 1);
+}
+
+void test_connect_failure() {
+    // grab a port with nothing listening on it
+    long port;
+    {
+        Listener listener("127.0.0.1");
+        port = listener.port;
+    }
+    StubResolver stub;
+    stub.table["local.test"] = {"127.0.0.1"};
+    fastws::Resolver resolver(std::chrono::seconds(60), std::ref(stub));
+
+    bool threw = false;
+    try {
+        fastws::SocketWrapper<> socket("local.test", port, resolver);
+    } catch (const fastws::SocketWrapperException&) {
+        threw = true;
+    }
+    CHECK(threw);
+    // and the address is forgotten so the next attempt looks it up again
+    CHECK(!resolver.cached("local.test", port));
+}
+
+void test_race() {
+    Listener listener("127.0.0.1");
+    StubResolver stub;
+    // nothing listens on 127.0.0.2, so that connect gets refused
+    stub.table["race.test"] = {"127.0.0.2", "127.0.0.1"};
+    fastws::Resolver resolver(std::chrono::seconds(60), std::ref(stub));
+
+    // first connect races TCP connects to both and remembers the winner
+    fastws::SocketWrapper<> first("race.test", listener.port, resolver);
+    auto preferred = resolver.preferred("race.test", listener.port);
+    CHECK(preferred.has_value());
+    CHECK(preferred->addr.to_string() == "127.0.0.1");
+    CHECK(resolver.try_get("race.test", listener.port)->front().to_string() ==
+          "127.0.0.1");
+
+    // which is used from then on, even after a refresh
+    fastws::SocketWrapper<> second("race.test", listener.port, resolver);
+    CHECK(stub.lookups == 1);
+    resolver.clear_preference("race.test", listener.port);
+    CHECK(!resolver.preferred("race.test", listener.port));
+    resolver.prefer("race.test", listener.port, preferred->addr);
+    CHECK(resolver.preferred("race.test", listener.port).has_value());
+}
+
+// more addresses than are raced at once, the first ones refused: each
+// refusal lets the next address in until one connects
+void test_race_past_failures() {
+    Listener listener("127.0.0.1");
+    StubResolver stub;
+    stub.table["refused.test"] = {"127.0.0.2", "127.0.0.3", "127.0.0.4",
+                                  "127.0.0.5", "127.0.0.6", "127.0.0.1"};
+    fastws::Resolver resolver(std::chrono::seconds(60), std::ref(stub));
+
+    fastws::SocketWrapper<> socket("refused.test", listener.port, resolver);
+    auto preferred = resolver.preferred("refused.test", listener.port);
+    CHECK(preferred.has_value() &&
+          (preferred->addr.to_string() == "127.0.0.1"));
+}
+
+// the listener takes the connection but never answers the ClientHello, so
+// the handshake has to give up on its own
+void test_tls_handshake_timeout() {
+    Listener listener("127.0.0.1");
+    fastws::AddressList addrs = {
+        fastws::ResolvedAddress::from_numeric("127.0.0.1", listener.port)};
+    const auto start = std::chrono::steady_clock::now();
+    bool threw = false;
+    try {
+        fastws::SSLSocketWrapper<> socket("localhost", listener.port, addrs,
+                                          {}, {}, 200);
+    } catch (const fastws::SSLSocketWrapperException&) {
+        threw = true;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(threw);
+    CHECK(elapsed >= std::chrono::milliseconds(190));
+    CHECK(elapsed < std::chrono::seconds(2));
+}
+
+int main() {
+    return test::run_tests(
+        test_cache, test_ttl, test_failure, test_slow_lookup,
+        [] { test_connect("127.0.0.1"); }, [] { test_connect("::1"); },
+        test_connect_failure, test_race, test_race_past_failures,
+        test_tls_handshake_timeout);
+}
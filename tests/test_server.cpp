@@ -0,0 +1,168 @@
+#include <fastws/fastws.hpp>
+
+#include "test_util.hpp"
+
+#include <iostream>
+#include <string>
+#include <thread>
+
+void test_accept_key() {
+    // the example from RFC 6455 section 1.3
+    CHECK(fastws::websocket_accept_key("dGhlIHNhbXBsZSBub25jZQ==") ==
+          "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+    const std::string request = "GET / HTTP/1.1\r\nHost: x\r\n"
+                                "sec-websocket-key:  abc \r\n\r\n";
+    CHECK(fastws::find_header(request, "Sec-WebSocket-Key") == "abc");
+    CHECK(fastws::find_header(request, "Upgrade").empty());
+}
+
+void test_mask() {
+    const std::uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+    std::uint8_t payload[200], masked[200];
+    for (int i = 0; i < 200; i++) {
+        payload[i] = (std::uint8_t)(i * 7);
+    }
+    for (std::size_t offset = 0; offset < 4; offset++) {
+        for (std::size_t len = 0; len <= 200; len++) {
+            fastws::mask_payload(masked, payload, len, key, offset);
+            bool ok = true;
+            for (std::size_t i = 0; i < len; i++) {
+                ok &= masked[i] == (payload[i] ^ key[(offset + i) % 4]);
+            }
+            CHECK(ok);
+        }
+    }
+}
+
+// a masked frame that comes in a byte at a time, and gets streamed
+void test_parser_unmasks() {
+    fastws::FrameFactory factory;
+    std::string payload(1000, 'a');
+    for (std::size_t i = 0; i < payload.size(); i++) {
+        payload[i] = (char)('a' + i % 26);
+    }
+    const std::string frame(factory.binary(true, true, payload));
+    for (std::uint64_t max_buffered : {std::uint64_t(1) << 20,
+                                       std::uint64_t(300)}) {
+        fastws::StreamingFrameParser parser;
+        parser.set_max_buffered_payload(max_buffered);
+        std::string out;
+        for (char c : frame) {
+            parser.frame_buffer().push_back(std::string_view(&c, 1));
+            for (auto f = parser.update(true); f.has_value();
+                 f = parser.update(false)) {
+                out += f->payload;
+            }
+        }
+        CHECK(out == payload);
+    }
+}
+
+struct ClientHandler {
+    using Client = fastws::NoTLSClient<ClientHandler>;
+    std::vector<std::string> received;
+    void on_open(Client& client) {}
+    void on_close(Client& client, bool success) {}
+    void on_text(Client& client, wsframe::Frame frame) {
+        received.emplace_back(frame.payload);
+    }
+    void on_binary(Client& client, wsframe::Frame frame) {
+        received.emplace_back(frame.payload);
+    }
+    void on_continuation(Client& client, wsframe::Frame frame) {}
+};
+
+static void poll_until(ClientHandler::Client& client, ClientHandler& handler,
+                       std::size_t count) {
+    const auto start = fastws::clock::now_ns();
+    while ((handler.received.size() < count) &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        client.drain();
+    }
+}
+
+void test_server() {
+    test::EchoServer server;
+    {
+        ClientHandler a_handler, b_handler;
+        ClientHandler::Client a(a_handler, "127.0.0.1", "/a", server.port());
+        ClientHandler::Client b(b_handler, "127.0.0.1", "/b", server.port());
+
+        // echo, all three payload length encodings
+        const std::string big(70000, 'x');
+        a.send_text("hello");
+        a.send_binary(std::string(200, 'y'));
+        a.send_binary(big);
+        poll_until(a, a_handler, 3);
+        CHECK(a_handler.received.size() == 3);
+        CHECK((a_handler.received.size() == 3) &&
+              (a_handler.received[0] == "hello") &&
+              (a_handler.received[1] == std::string(200, 'y')) &&
+              (a_handler.received[2] == big));
+
+        // one frame out to everyone
+        b.send_text("broadcast");
+        poll_until(a, a_handler, 4);
+        poll_until(b, b_handler, 1);
+        CHECK((a_handler.received.size() == 4) &&
+              (a_handler.received[3] == "to everyone"));
+        CHECK((b_handler.received.size() == 1) &&
+              (b_handler.received[0] == "to everyone"));
+
+        // pings are answered
+        a.set_ping_interval(std::chrono::milliseconds(1),
+                            std::chrono::milliseconds(1000));
+        const auto start = fastws::clock::now_ns();
+        while ((a.rtt_stats().count() < 3) &&
+               (fastws::clock::now_ns() - start < 2000000000ull)) {
+            a.drain();
+        }
+        CHECK(a.rtt_stats().count() >= 3);
+
+        a.close(1);
+        while (!a.closed())
+            a.drain();
+        CHECK(a.status() == fastws::ConnectionStatus::CLOSED_BY_CLIENT);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    server.stop();
+    CHECK(server.handler().opened == 2);
+    CHECK(server.handler().closed == 2);
+    CHECK(server.server().connections() == 0);
+}
+
+// a request that never ends is turned away once it passes max_request_size,
+// however fast it keeps coming
+void test_request_too_big() {
+    test::EchoServer server;
+    const auto addr =
+        fastws::ResolvedAddress::from_numeric("127.0.0.1", server.port());
+    const int fd = ::socket(addr.family(), SOCK_STREAM, 0);
+    CHECK(::connect(fd, addr.get(), addr.len) == 0);
+    const std::string junk = "GET / HTTP/1.1\r\nX: " + std::string(4096, 'x');
+    // the server closes with our junk still unread, so the 400 can be lost
+    // to the reset, all that counts is that the connection goes
+    bool closed = false;
+    char buf[256];
+    const auto start = fastws::clock::now_ns();
+    while (!closed && (fastws::clock::now_ns() - start < 2000000000ull)) {
+        if ((::send(fd, junk.data(), junk.size(),
+                    MSG_NOSIGNAL | MSG_DONTWAIT) < 0) &&
+            (errno != EAGAIN) && (errno != EWOULDBLOCK))
+            closed = true;
+        const ssize_t n = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if ((n == 0) ||
+            ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+            closed = true;
+    }
+    ::close(fd);
+    CHECK(closed);
+    server.stop();
+    CHECK(server.handler().opened == 0);
+    CHECK(server.server().connections() == 0);
+}
+
+int main() {
+    return test::run_tests(test_accept_key, test_mask, test_parser_unmasks,
+                           test_server, test_request_too_big);
+}
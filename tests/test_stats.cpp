@@ -0,0 +1,151 @@
+#include <fastws/fastws.hpp>
+
+#include "test_util.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// The connection counters add up to what was sent and received, and can be
+// read from another thread while the client is polling. TCP_INFO is sampled
+// on its own timer, with or without pings.
+
+struct ClientHandler {
+    using Client = fastws::NoTLSClient<ClientHandler>;
+    std::size_t received = 0;
+    void on_binary(Client& client, wsframe::Frame frame) { received++; }
+};
+
+static constexpr std::size_t sizes[] = {10, 200, 3000, 200000};
+static constexpr int rounds = 50;
+
+void test_counters(long port) {
+    ClientHandler handler;
+    ClientHandler::Client client(handler, "127.0.0.1", "/", port);
+    const std::string payload(200000, 'x');
+
+    // a monitor reading everything while the client works
+    std::atomic<bool> stop{false};
+    std::uint64_t monitor_max = 0;
+    std::thread monitor([&] {
+        while (!stop) {
+            const auto snapshot = client.stats().snapshot();
+            monitor_max = std::max(monitor_max, snapshot.frames_in[2]);
+        }
+    });
+
+    std::uint64_t bytes = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (std::size_t size : sizes) {
+            const std::size_t expected = handler.received + 1;
+            client.send_binary(std::string_view(payload).substr(0, size));
+            bytes += size;
+            const auto start = fastws::clock::now_ns();
+            while ((handler.received < expected) &&
+                   (fastws::clock::now_ns() - start < 2000000000ull)) {
+                client.drain();
+            }
+        }
+    }
+    stop = true;
+    monitor.join();
+
+    const auto stats = client.stats().snapshot();
+    const std::size_t binary = 2;
+    CHECK(handler.received == rounds * 4);
+    CHECK(stats.frames_out[binary] == rounds * 4);
+    CHECK(stats.bytes_out[binary] == bytes);
+    CHECK(stats.frames_in[binary] == rounds * 4);
+    CHECK(stats.bytes_in[binary] == bytes);
+    CHECK(monitor_max <= stats.frames_in[binary]);
+    CHECK(stats.largest_frame_in == 200000);
+    CHECK(stats.largest_frame_out == 200000);
+    CHECK(stats.send_buffer_high_water > 200000);
+    CHECK(stats.receive_buffer_high_water >= 200000);
+    CHECK(stats.socket_bytes_in > bytes);
+    CHECK(stats.socket_bytes_out > bytes);
+    CHECK(stats.recv_calls > 0);
+    CHECK(stats.send_calls >= rounds * 4);
+    CHECK(stats.ioctl_calls > 0);
+    // the big frames can't come in with one read
+    CHECK(stats.partial_frames > 0);
+
+    const std::string json = stats.to_json();
+    CHECK(json.find("\"in_frames_binary\":" + std::to_string(rounds * 4)) !=
+          std::string::npos);
+    CHECK(json.find("text") == std::string::npos);
+    CHECK(stats.to_text().find("largest_frame_in 200000\n") !=
+          std::string::npos);
+
+    client.close(1);
+    while (!client.closed())
+        client.drain();
+    CHECK(client.stats().frames_out[8].load() == 1);
+}
+
+void test_tcp_info(long port) {
+    ClientHandler handler;
+    ClientHandler::Client client(handler, "127.0.0.1", "/", port);
+    // sampled on connecting
+    CHECK(client.tcp_info().valid());
+    CHECK(client.stats().tcp_samples.load() == 1);
+
+    client.set_ping_interval(std::chrono::milliseconds(1),
+                             std::chrono::milliseconds(1000));
+    client.set_tcp_info_interval(std::chrono::milliseconds(1));
+    const auto start = fastws::clock::now_ns();
+    while ((client.stats().ping_rtt_ns.load() == 0 ||
+            client.stats().tcp_samples.load() < 5) &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        client.drain();
+    }
+    const auto stats = client.stats().snapshot();
+    CHECK(stats.ping_rtt_ns == client.rtt_stats().last());
+    CHECK(stats.tcp_samples >= 5);
+
+    const fastws::TcpInfo& info = client.sample_tcp_info();
+    CHECK(info.valid());
+    CHECK(info.cwnd > 0);
+    CHECK(info.rcv_space > 0);
+    CHECK(client.stats().tcp_cwnd.load() == info.cwnd);
+    CHECK(client.stats().tcp_rcv_space.load() == info.rcv_space);
+    CHECK(client.last_tcp_rtt() == info.rtt_us / 1000.0);
+}
+
+struct LeanHandler {
+    using Client = fastws::NoTLSClient<LeanHandler, fastws::LeanFeatures>;
+};
+
+// no pings and no counters, from poll() and from a wheel
+void test_tcp_info_without_pings(long port, bool wheel) {
+    LeanHandler handler;
+    LeanHandler::Client client(handler, "127.0.0.1", "/", port);
+    fastws::TimerWheel timers;
+    if (wheel)
+        client.attach(timers);
+    CHECK(client.tcp_info().valid());
+    const std::uint64_t first = client.tcp_info().sampled_at;
+    client.set_tcp_info_interval(std::chrono::milliseconds(1));
+    const auto start = fastws::clock::now_ns();
+    while ((client.tcp_info().sampled_at == first) &&
+           (fastws::clock::now_ns() - start < 2000000000ull)) {
+        timers.poll();
+        client.poll();
+    }
+    CHECK(client.tcp_info().sampled_at > first);
+    client.detach();
+}
+
+int main() {
+    test::EchoServer server;
+    return test::run_tests([&] { test_counters(server.port()); },
+                           [&] { test_tcp_info(server.port()); },
+                           [&] {
+                               test_tcp_info_without_pings(server.port(),
+                                                           false);
+                           },
+                           [&] {
+                               test_tcp_info_without_pings(server.port(), true);
+                           });
+}
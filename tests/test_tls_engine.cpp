@@ -0,0 +1,143 @@
+#include <fastws/buffer_pool.hpp>
+#include <fastws/tls_engine.hpp>
+
+#include "test_util.hpp"
+
+#include <iostream>
+#include <string>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+// server context with a throwaway self-signed certificate
+static SSL_CTX* make_server_ctx() {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               (const unsigned char*)"localhost", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate(ctx, cert);
+    SSL_CTX_use_PrivateKey(ctx, key);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ctx;
+}
+
+// the other end, a plain OpenSSL server on a pair of memory BIOs
+struct Server {
+    SSL* ssl;
+    BIO* in = BIO_new(BIO_s_mem());
+    BIO* out = BIO_new(BIO_s_mem());
+
+    Server(SSL_CTX* ctx) : ssl(SSL_new(ctx)) {
+        SSL_set_bio(ssl, in, out);
+        SSL_set_accept_state(ssl);
+    }
+
+    ~Server() { SSL_free(ssl); }
+};
+
+// moves ciphertext both ways, like a transport would
+static void pump(fastws::TLSEngine& client, Server& server) {
+    for (auto out = client.outgoing(); !out.empty(); out = client.outgoing()) {
+        BIO_write(server.in, out.data(), out.size());
+        client.consume_outgoing(out.size());
+    }
+    char* data;
+    const long len = BIO_get_mem_data(server.out, &data);
+    const std::size_t fed = client.feed(std::string_view(data, len));
+    std::string rest(data + fed, len - fed);
+    (void)BIO_reset(server.out);
+    BIO_write(server.out, rest.data(), rest.size());
+}
+
+static bool handshake(fastws::TLSEngine& client, Server& server) {
+    for (int i = 0; i < 10; i++) {
+        client.handshake();
+        pump(client, server);
+        SSL_do_handshake(server.ssl);
+        pump(client, server);
+        if (client.handshake_done() && SSL_is_init_finished(server.ssl))
+            return true;
+    }
+    return false;
+}
+
+void test_handshake_and_echo() {
+    SSL_CTX* server_ctx = make_server_ctx();
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    Server server(server_ctx);
+    fastws::TLSEngine client(client_ctx, "localhost");
+
+    CHECK(!client.handshake_done());
+    CHECK(handshake(client, server));
+    CHECK(client.buffer_size() > 0);
+
+    // client -> server
+    CHECK(client.write("hello") == 5);
+    pump(client, server);
+    char buf[64];
+    std::size_t read = 0;
+    SSL_read_ex(server.ssl, buf, sizeof(buf), &read);
+    CHECK(std::string(buf, read) == "hello");
+
+    // server -> client, lots of small records come out in one read_into
+    for (int i = 0; i < 100; i++) {
+        SSL_write(server.ssl, "0123456789", 10);
+    }
+    pump(client, server);
+    CHECK(client.has_pending());
+    fastws::PooledBuffer buffer;
+    CHECK(client.read_into(buffer, 1 << 16) == 1000);
+    CHECK(buffer.size() == 1000);
+    CHECK(!client.has_pending());
+
+    // half a record isn't anything yet
+    SSL_write(server.ssl, "abcdef", 6);
+    char* data;
+    const long len = BIO_get_mem_data(server.out, &data);
+    std::string record(data, len);
+    (void)BIO_reset(server.out);
+    client.feed(std::string_view(record).substr(0, len / 2));
+    CHECK(client.read(buf, sizeof(buf)) == 0);
+    CHECK(!client.has_pending());
+    client.feed(std::string_view(record).substr(len / 2));
+    CHECK(client.has_pending());
+    CHECK(client.read(buf, sizeof(buf)) == 6);
+
+    // close_notify
+    SSL_shutdown(server.ssl);
+    pump(client, server);
+    CHECK(client.read(buf, sizeof(buf)) == 0);
+    CHECK(client.closed());
+
+    SSL_CTX_free(client_ctx);
+    SSL_CTX_free(server_ctx);
+}
+
+void test_bad_handshake() {
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    fastws::TLSEngine client(client_ctx, "localhost");
+    client.handshake();
+    client.feed("this is not a TLS record at all");
+    bool threw = false;
+    try {
+        client.handshake();
+    } catch (const fastws::TLSEngineException&) {
+        threw = true;
+    }
+    CHECK(threw);
+    SSL_CTX_free(client_ctx);
+}
+
+int main() {
+    return test::run_tests(test_handshake_and_echo, test_bad_handshake);
+}
@@ -0,0 +1,154 @@
+#include <fastws/utf8.hpp>
+
+#include "test_util.hpp"
+
+#include <string>
+#include <vector>
+
+// Every validator (scalar, SSE4, AVX2 and the incremental one) against a
+// table of valid and invalid sequences, placed at every offset around the
+// 16 and 32 byte blocks and split at every point between fragments.
+
+struct Case {
+    const char* name;
+    std::string bytes;
+    bool valid;
+};
+
+static const std::vector<Case> cases = {
+    {"empty", "", true},
+    {"ascii", "a", true},
+    {"2 bytes, lowest", "\xc2\x80", true},
+    {"2 bytes, highest", "\xdf\xbf", true},
+    {"3 bytes, lowest", "\xe0\xa0\x80", true},
+    {"euro sign", "\xe2\x82\xac", true},
+    {"before the surrogates", "\xed\x9f\xbf", true},
+    {"after the surrogates", "\xee\x80\x80", true},
+    {"3 bytes, highest", "\xef\xbf\xbf", true},
+    {"4 bytes, lowest", "\xf0\x90\x80\x80", true},
+    {"U+10FFFF", "\xf4\x8f\xbf\xbf", true},
+    {"mixed", "h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80!", true},
+
+    {"overlong 2 bytes, C0", "\xc0\x80", false},
+    {"overlong 2 bytes, C1", "\xc1\xbf", false},
+    {"overlong 3 bytes", "\xe0\x80\x80", false},
+    {"overlong 3 bytes, highest", "\xe0\x9f\xbf", false},
+    {"overlong 4 bytes", "\xf0\x80\x80\x80", false},
+    {"overlong 4 bytes, highest", "\xf0\x8f\xbf\xbf", false},
+
+    {"lowest surrogate", "\xed\xa0\x80", false},
+    {"highest surrogate", "\xed\xbf\xbf", false},
+    {"surrogate pair", "\xed\xa0\xbd\xed\xb8\x80", false},
+
+    {"U+110000", "\xf4\x90\x80\x80", false},
+    {"F5 lead", "\xf5\x80\x80\x80", false},
+    {"F7 lead", "\xf7\xbf\xbf\xbf", false},
+    {"5 bytes", "\xf8\x88\x80\x80\x80", false},
+    {"FE", "\xfe", false},
+    {"FF", "\xff", false},
+
+    {"stray continuation", "\x80", false},
+    {"stray continuation, last", "\xbf", false},
+    {"stray continuation between ascii", "a\x80" "b", false},
+    {"extra continuation", "\xc2\x80\x80", false},
+    {"extra continuation after 4 bytes", "\xf0\x9f\x98\x80\x80", false},
+
+    {"cut off 2 bytes", "\xc2", false},
+    {"cut off 3 bytes", "\xe2\x82", false},
+    {"cut off 4 bytes", "\xf0\x9f\x98", false},
+    {"cut off 3 bytes, then ascii", "\xe2\x82" "a", false},
+    {"cut off 4 bytes, then ascii", "\xf0\x9f\x98" "a", false},
+    {"cut off 2 bytes, then a sequence", "\xc2\xc2\x80", false},
+};
+
+static std::vector<fastws::utf8::Implementation> implementations() {
+    using fastws::utf8::Implementation;
+    std::vector<Implementation> out = {Implementation::SCALAR};
+    const Implementation best = fastws::utf8::detect_implementation();
+    if (best != Implementation::SCALAR)
+        out.push_back(Implementation::SSE4);
+    if (best == Implementation::AVX2)
+        out.push_back(Implementation::AVX2);
+    return out;
+}
+
+static void report(const Case& c, const char* how,
+                   fastws::utf8::Implementation impl, std::size_t offset,
+                   std::size_t split) {
+    std::cout << c.name << ": " << how << " "
+              << fastws::utf8::implementation_to_string(impl) << ", offset "
+              << offset << ", split " << split << std::endl;
+}
+
+// the case with offset bytes of ascii in front and after bytes behind, so
+// it lands on either side of every block boundary
+static std::string place(const Case& c, std::size_t offset,
+                         std::size_t after) {
+    return std::string(offset, 'a') + c.bytes + std::string(after, 'b');
+}
+
+void test_whole() {
+    for (auto impl : implementations()) {
+        for (const auto& c : cases) {
+            bool ok = true;
+            for (std::size_t offset = 0; ok && (offset <= 40); offset++) {
+                for (std::size_t after : {0, 5, 37}) {
+                    const std::string input = place(c, offset, after);
+                    if (fastws::utf8::is_valid(input, impl) != c.valid) {
+                        report(c, "is_valid", impl, offset, after);
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+            CHECK(ok);
+        }
+    }
+}
+
+void test_incremental() {
+    for (auto impl : implementations()) {
+        for (const auto& c : cases) {
+            bool ok = true;
+            for (std::size_t offset = 0; ok && (offset <= 40); offset++) {
+                const std::string input = place(c, offset, 20);
+                fastws::Utf8Validator validator(impl);
+                // two fragments, split everywhere
+                for (std::size_t split = 0; split <= input.size(); split++) {
+                    validator.reset();
+                    validator.update(std::string_view(input).substr(0, split));
+                    if (validator.finish(
+                            std::string_view(input).substr(split)) !=
+                        c.valid) {
+                        report(c, "two fragments", impl, offset, split);
+                        ok = false;
+                        break;
+                    }
+                }
+                // a byte at a time
+                validator.reset();
+                for (std::size_t i = 0; i < input.size(); i++)
+                    validator.update(std::string_view(input).substr(i, 1));
+                if (ok && (validator.finish() != c.valid)) {
+                    report(c, "byte at a time", impl, offset, 1);
+                    ok = false;
+                }
+            }
+            CHECK(ok);
+        }
+    }
+}
+
+// once invalid, the validator stays invalid until reset()
+void test_stays_invalid() {
+    fastws::Utf8Validator validator;
+    CHECK(!validator.update("\xc0\x80"));
+    CHECK(!validator.update("abc"));
+    CHECK(!validator.finish("abc"));
+    // finish() resets
+    CHECK(validator.finish("abc"));
+}
+
+int main() {
+    return test::run_tests(test_whole, test_incremental, test_stays_invalid);
+}
@@ -0,0 +1,98 @@
+#ifndef _FASTWS_TEST_UTIL_HPP_
+#define _FASTWS_TEST_UTIL_HPP_
+
+#include <fastws/server.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+// What every test shares: CHECK, run_tests() to run them and report, and a
+// local WSServer polled on its own thread.
+
+namespace test {
+
+inline int failures = 0;
+
+// runs each test in order, then prints the result for ctest
+template <class... Tests> int run_tests(Tests&&... tests) {
+    (tests(), ...);
+    if (failures > 0) {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all passed" << std::endl;
+    return 0;
+}
+
+// Echoes text and binary messages back, except "broadcast", which sends
+// "to everyone" to every connection. Counts connections opened and closed.
+struct EchoHandler {
+    using Server = fastws::WSServer<EchoHandler>;
+    int opened = 0;
+    int closed = 0;
+    void on_open(Server& server, Server::Connection& conn) { opened++; }
+    void on_close(Server& server, Server::Connection& conn) { closed++; }
+    void on_text(Server& server, Server::Connection& conn,
+                 wsframe::Frame frame) {
+        if (frame.payload == "broadcast") {
+            server.broadcast_text("to everyone");
+        } else {
+            conn.send_text(frame.payload);
+        }
+    }
+    void on_binary(Server& server, Server::Connection& conn,
+                   wsframe::Frame frame) {
+        conn.send_binary(frame.payload);
+    }
+    void on_continuation(Server& server, Server::Connection& conn,
+                         wsframe::Frame frame) {}
+};
+
+// A WSServer on a free port of 127.0.0.1, polled on a thread of its own
+// until stop() (or the destructor).
+template <class Handler = EchoHandler> class ServerThread {
+  private:
+    Handler m_handler;
+    fastws::WSServer<Handler> m_server;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+
+  public:
+    ServerThread()
+        : m_server(m_handler, "127.0.0.1", 0), m_thread([this] {
+              while (!m_stop)
+                  m_server.poll(1);
+          }) {}
+
+    ServerThread(const ServerThread&) = delete;
+    ServerThread& operator=(const ServerThread&) = delete;
+
+    ~ServerThread() { stop(); }
+
+    void stop() {
+        m_stop = true;
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    long port() const { return m_server.port(); }
+
+    // only safe to look at once stopped
+    Handler& handler() { return m_handler; }
+    fastws::WSServer<Handler>& server() { return m_server; }
+};
+
+using EchoServer = ServerThread<EchoHandler>;
+
+} // namespace test
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            std::cout << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+            test::failures++;                                                  \
+        }                                                                      \
+    } while (0)
+
+#endif // _FASTWS_TEST_UTIL_HPP_